@@ -0,0 +1,160 @@
+/**
+ * balance.c
+ *
+ * CS 470 Project 4
+ *
+ * Placement report: reads a DHT input file and shows how its distinct keys
+ * (and their bytes: key characters plus the value) would be spread over the
+ * processes, with the original hash % nprocs and with the consistent-hash
+ * ring. Also shows what share of the keys would move if one more process
+ * were added.
+ *
+ * Usage: balance <nprocs> <in-file> [vnodes] [djb2|fnv1a|murmur]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "local.h"
+#include "ring.h"
+
+#define MAX_LINE_LEN 1024
+
+/*
+ * Distinct keys of the input file
+ */
+static char (*keys)[MAX_KEYLEN];
+static size_t key_count;
+
+static int compare_keys(const void *a, const void *b)
+{
+    return strncmp((const char *)a, (const char *)b, MAX_KEYLEN);
+}
+
+static void read_keys(FILE *fin)
+{
+    size_t cap = 1024;
+    keys = malloc(cap * sizeof(*keys));
+    char line[MAX_LINE_LEN];
+    while (fgets(line, MAX_LINE_LEN, fin) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        char *cmd = strtok(line, " \n");
+        if (cmd == NULL || strcmp(cmd, "put") != 0) {
+            continue;
+        }
+        char *key = strtok(NULL, " \n");
+        if (key == NULL) {
+            continue;
+        }
+        if (key_count == cap) {
+            cap *= 2;
+            keys = realloc(keys, cap * sizeof(*keys));
+        }
+        snprintf(keys[key_count++], MAX_KEYLEN, "%s", key);
+    }
+
+    // drop repeated puts of the same key
+    qsort(keys, key_count, sizeof(*keys), compare_keys);
+    size_t n = 0;
+    for (size_t i = 0; i < key_count; i++) {
+        if (n == 0 || strcmp(keys[n-1], keys[i]) != 0) {
+            memmove(keys[n++], keys[i], MAX_KEYLEN);
+        }
+    }
+    key_count = n;
+}
+
+/*
+ * Owner of key i under a placement: the ring if one is given, else modulo
+ */
+static int owner(const struct ring *ring, ring_hash_fn hash, int nprocs, size_t i)
+{
+    if (ring != NULL) {
+        return ring_owner(ring, keys[i]);
+    }
+    return (int)(hash(keys[i]) % (unsigned)nprocs);
+}
+
+/*
+ * Print the per-process counts of one placement and the share of keys that
+ * move when a process is added
+ */
+static void report(const char *name, int nprocs, int vnodes, ring_hash_fn hash)
+{
+    struct ring ring, grown;
+    if (vnodes > 0) {
+        ring_init(&ring, nprocs, vnodes, hash);
+        ring_init(&grown, nprocs + 1, vnodes, hash);
+    }
+    size_t *counts = calloc(nprocs, sizeof(size_t));
+    size_t *bytes = calloc(nprocs, sizeof(size_t));
+    size_t moved = 0;
+    for (size_t i = 0; i < key_count; i++) {
+        int p = owner(vnodes > 0 ? &ring : NULL, hash, nprocs, i);
+        counts[p]++;
+        bytes[p] += strlen(keys[i]) + sizeof(long);
+        moved += p != owner(vnodes > 0 ? &grown : NULL, hash, nprocs + 1, i);
+    }
+
+    printf("%s:\n", name);
+    printf("  %6s  %10s  %12s\n", "rank", "keys", "bytes");
+    size_t max_count = 0, max_bytes = 0, total_bytes = 0;
+    for (int p = 0; p < nprocs; p++) {
+        printf("  %6d  %10lu  %12lu\n", p, (unsigned long)counts[p],
+                (unsigned long)bytes[p]);
+        max_count = counts[p] > max_count ? counts[p] : max_count;
+        max_bytes = bytes[p] > max_bytes ? bytes[p] : max_bytes;
+        total_bytes += bytes[p];
+    }
+
+    // imbalance is the largest share divided by the mean share
+    double mean_count = (double)key_count / nprocs;
+    double mean_bytes = (double)total_bytes / nprocs;
+    printf("  imbalance (max/mean): keys %.3f  bytes %.3f\n",
+            mean_count > 0 ? max_count / mean_count : 1.0,
+            mean_bytes > 0 ? max_bytes / mean_bytes : 1.0);
+    printf("  keys moved going to %d processes: %.1f%%\n", nprocs + 1,
+            key_count > 0 ? 100.0 * moved / key_count : 0.0);
+
+    free(counts);
+    free(bytes);
+    if (vnodes > 0) {
+        ring_destroy(&ring);
+        ring_destroy(&grown);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        printf("Usage: %s <nprocs> <in-file> [vnodes] [djb2|fnv1a|murmur]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int nprocs = (int)strtol(argv[1], NULL, 10);
+    int vnodes = argc > 3 ? (int)strtol(argv[3], NULL, 10) : 64;
+    ring_hash_fn hash = argc > 4 ? ring_hash_by_name(argv[4]) : ring_hash_djb2;
+    if (nprocs < 1 || vnodes < 1 || hash == NULL) {
+        printf("ERROR: invalid process count, virtual nodes or hash\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *fin = fopen(argv[2], "r");
+    if (fin == NULL) {
+        printf("ERROR: Could not open file \"%s\"\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    read_keys(fin);
+    fclose(fin);
+
+    printf("%lu distinct keys, %d processes\n\n", (unsigned long)key_count, nprocs);
+    report("hash % nprocs", nprocs, 0, hash);
+    char name[64];
+    snprintf(name, sizeof(name), "ring, %d virtual nodes per process", vnodes);
+    report(name, nprocs, vnodes, hash);
+
+    free(keys);
+    return EXIT_SUCCESS;
+}
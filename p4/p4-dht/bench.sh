@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+#SBATCH --job-name=dht_bench
+#SBATCH --nodes=1
+#SBATCH --ntasks=8
+
+OPS=50000
+NP=8
+
+make bench_dht
+
+echo "SERVER THREADS:"
+for t in 1 2 4 8; do
+    DHT_SERVER_THREADS=$t mpirun -np $NP ./bench_dht "$OPS"
+done
+
+echo "READ CACHE (10000 distinct keys):"
+for c in 0 1000 10000; do
+    DHT_CACHE_SIZE=$c mpirun -np $NP ./bench_dht "$OPS" 10000
+done
+
+echo "BACKEND (two-sided vs one-sided):"
+for b in message rma; do
+    DHT_BACKEND=$b DHT_RMA_SLOTS=262144 mpirun -np $NP ./bench_dht "$OPS"
+done
+DHT_BACKEND=rma DHT_SHM=1 DHT_RMA_SLOTS=262144 mpirun -np $NP ./bench_dht "$OPS"
+
+echo "PROGRESS ENGINE (server threads vs serving inside client calls):"
+for p in 0 1; do
+    DHT_PROGRESS=$p mpirun -np $NP ./bench_dht "$OPS"
+done
+
+echo "CLIENT THREADS (per process):"
+make bench_threads
+for t in 0 1; do
+    DHT_ASYNC_PUT=$t mpirun -np $NP ./bench_threads "$OPS" 1 2 4 8
+done
+
+echo "TRACE (Zipf keys, 90% gets, latency percentiles):"
+make bench_trace gen_trace
+for np in 1 2 4 8; do
+    ./gen_trace -d zipf -r 0.9 -l 4:32 "$np" "$OPS" > trace-$np.txt
+    mpirun -np $np ./bench_trace trace-$np.txt
+    rm -f trace-$np.txt
+done
+
+echo "HOT-KEY REPLICATION (Zipf keys, 99% gets):"
+./gen_trace -d zipf -s 1.2 -r 0.99 "$NP" "$OPS" > trace-hot.txt
+for t in 0 64 1024; do
+    DHT_HOT_THRESHOLD=$t mpirun -np $NP ./bench_trace trace-hot.txt
+done
+rm -f trace-hot.txt
@@ -0,0 +1,116 @@
+/**
+ * bench_dht.c
+ *
+ * CS 470 Project 4
+ *
+ * Throughput benchmark for the DHT. Every process puts and then gets a number
+ * of random keys, first with dht_get and then with up to WINDOW dht_iget
+ * requests in flight; process 0 reports the aggregate rate of each phase. DHT
+ * options come from the environment (see dht.h); with DHT_CACHE_SIZE set, the
+ * cache hit rate of the get phase is reported too.
+ *
+ * Usage: bench_dht <ops-per-process> [key-space]
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dht.h"
+
+// Non-blocking gets each process keeps in flight
+#define WINDOW 64
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("Usage: %s <ops-per-process> [key-space]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    long ops = strtol(argv[1], NULL, 10);
+    unsigned long space = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+
+    struct dht_options opts;
+    dht_default_options(&opts);
+    int pid = dht_init_opts(&opts);
+    int nprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    // pre-generate this process's keys so only DHT calls are timed
+    char (*keys)[16] = malloc(ops * sizeof(*keys));
+    unsigned seed = 12345 + 7919 * (unsigned)pid;
+    for (long i = 0; i < ops; i++) {
+        seed = 1664525u * seed + 1013904223u;
+        snprintf(keys[i], sizeof(keys[i]), "key%lu", (unsigned long)(seed % space));
+    }
+
+    // put phase (includes the sync that makes the puts visible)
+    dht_sync();
+    double put_time = MPI_Wtime();
+    for (long i = 0; i < ops; i++) {
+        dht_put(keys[i], i);
+    }
+    dht_sync();
+    put_time = MPI_Wtime() - put_time;
+
+    // get phase
+    long found = 0;
+    double get_time = MPI_Wtime();
+    for (long i = 0; i < ops; i++) {
+        found += dht_get(keys[i]) != KEY_NOT_FOUND;
+    }
+    get_time = MPI_Wtime() - get_time;
+
+    // windowed non-blocking get phase
+    long ifound = 0;
+    long values[WINDOW];
+    struct dht_request *reqs[WINDOW];
+    double iget_time = MPI_Wtime();
+    for (long base = 0; base < ops; base += WINDOW) {
+        int n = ops - base < WINDOW ? (int)(ops - base) : WINDOW;
+        for (int i = 0; i < n; i++) {
+            reqs[i] = dht_iget(keys[base + i], &values[i]);
+        }
+        dht_waitall(reqs, n);
+        for (int i = 0; i < n; i++) {
+            ifound += values[i] != KEY_NOT_FOUND;
+        }
+    }
+    iget_time = MPI_Wtime() - iget_time;
+
+    // every process has its replies before any leaves the DHT (without
+    // server threads, a process only serves others inside DHT calls)
+    dht_sync();
+
+    double times[3] = { put_time, get_time, iget_time };
+    double max_times[3];
+    MPI_Reduce(times, max_times, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    struct cache_stats stats;
+    dht_cache_stats(&stats);
+    unsigned long counts[2] = { stats.hits, stats.misses };
+    unsigned long total_counts[2];
+    MPI_Reduce(counts, total_counts, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (pid == 0) {
+        double total = (double)ops * nprocs;
+        printf("procs=%d backend=%s servers=%d async=%d  put: %10.0f ops/s  get: %10.0f ops/s"
+                "  iget: %10.0f ops/s",
+                nprocs, opts.backend == DHT_BACKEND_RMA ? (opts.shm ? "rma+shm" : "rma") :
+                opts.progress ? "progress" : "message",
+                opts.server_threads, (int)opts.async_put,
+                total / max_times[0], total / max_times[1], total / max_times[2]);
+        if (opts.cache_size > 0) {
+            printf("  cache=%lu hit rate: %5.1f%%", (unsigned long)opts.cache_size,
+                    100.0 * total_counts[0] / (total_counts[0] + total_counts[1] + 1e-9));
+        }
+        printf("\n");
+    }
+    if (found != ops || ifound != ops) {
+        printf("ERROR: process %d found %ld of %ld keys\n", pid, found, ops);
+    }
+
+    FILE *null_out = fopen("/dev/null", "w");
+    dht_destroy(null_out);
+    fclose(null_out);
+    free(keys);
+    return EXIT_SUCCESS;
+}
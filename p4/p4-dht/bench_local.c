@@ -0,0 +1,169 @@
+/**
+ * bench_local.c
+ *
+ * CS 470 Project 4
+ *
+ * Microbenchmark for the local key-value table. Times bulk puts and gets of
+ * distinct random keys against the table in local.c and against the original
+ * sorted-array implementation (kept below as a reference).
+ *
+ * Usage: bench_local [max-sorted-keys]
+ *
+ * The sorted array needs O(n^2) work to load n keys, so it is only run up to
+ * max-sorted-keys (default 100000).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "local.h"
+#include "timer.h"
+
+/*
+ * Reference implementation: sorted array with binary search and shifting
+ * inserts (the original local.c)
+ */
+
+struct ref_pair {
+    char key[MAX_KEYLEN];
+    long value;
+};
+
+static struct ref_pair *ref_pairs;
+static size_t ref_count;
+
+static size_t ref_find(const char *key)
+{
+    if (ref_count == 0) return 0;
+
+    size_t lo = 0;
+    size_t hi = ref_count;
+    while (lo < hi-1) {
+        size_t mid = (lo + hi) / 2;
+        if (strncmp(key, ref_pairs[mid].key, MAX_KEYLEN) < 0) {
+            hi = mid;
+        } else if (strncmp(key, ref_pairs[mid].key, MAX_KEYLEN) > 0) {
+            lo = mid + 1;
+        } else {
+            lo = mid;
+        }
+    }
+    if (lo < ref_count && strncmp(key, ref_pairs[lo].key, MAX_KEYLEN) > 0) {
+        lo++;
+    }
+    return lo;
+}
+
+static void ref_put(const char *key, long value)
+{
+    size_t idx = ref_find(key);
+    if (idx < ref_count && strncmp(key, ref_pairs[idx].key, MAX_KEYLEN) == 0) {
+        ref_pairs[idx].value = value;
+    } else {
+        for (size_t i = ref_count; i > idx; i--) {
+            memcpy(&ref_pairs[i], &ref_pairs[i-1], sizeof(struct ref_pair));
+        }
+        snprintf(ref_pairs[idx].key, MAX_KEYLEN, "%s", key);
+        ref_pairs[idx].value = value;
+        ref_count++;
+    }
+}
+
+static long ref_get(const char *key)
+{
+    size_t idx = ref_find(key);
+    if (idx < ref_count && strncmp(key, ref_pairs[idx].key, MAX_KEYLEN) == 0) {
+        return ref_pairs[idx].value;
+    }
+    return KEY_NOT_FOUND;
+}
+
+/*
+ * Generates n distinct keys in random order (a full-period LCG over 2^32 never
+ * repeats a value, so the keys are unique)
+ */
+static char (*make_keys(size_t n))[16]
+{
+    char (*keys)[16] = malloc(n * sizeof(*keys));
+    unsigned seed = 12345;
+    for (size_t i = 0; i < n; i++) {
+        seed = 1664525u * seed + 1013904223u;
+        snprintf(keys[i], sizeof(keys[i]), "k%08x", seed);
+    }
+    return keys;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_sorted = 100000;
+    if (argc > 1) {
+        max_sorted = strtoul(argv[1], NULL, 10);
+    }
+
+    static const size_t sizes[] = { 10000, 100000, 1000000 };
+
+    printf("%10s  %-6s  %10s  %10s  %12s  %12s  %10s\n",
+            "keys", "table", "put (s)", "get (s)", "put (ns/op)", "get (ns/op)",
+            "peak (MB)");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        char (*keys)[16] = make_keys(n);
+        long check = 0;
+
+        // hash table (local.c)
+        local_init();
+        START_TIMER(hput)
+        for (size_t i = 0; i < n; i++) {
+            local_put(keys[i], (long)i);
+        }
+        STOP_TIMER(hput)
+        START_TIMER(hget)
+        for (size_t i = 0; i < n; i++) {
+            check += local_get(keys[i]);
+        }
+        STOP_TIMER(hget)
+        if (local_size() != n) {
+            printf("ERROR: hash table holds %lu of %lu keys\n",
+                    (unsigned long)local_size(), (unsigned long)n);
+        }
+        printf("%10lu  %-6s  %10.4f  %10.4f  %12.1f  %12.1f  %10.1f\n",
+                (unsigned long)n, "hash", GET_TIMER(hput), GET_TIMER(hget),
+                GET_TIMER(hput) * 1e9 / n, GET_TIMER(hget) * 1e9 / n,
+                local_peak_bytes() / 1048576.0);
+        FILE *null_out = fopen("/dev/null", "w");
+        local_destroy(null_out);
+        fclose(null_out);
+
+        // sorted array (reference)
+        if (n <= max_sorted) {
+            ref_pairs = malloc(n * sizeof(struct ref_pair));
+            ref_count = 0;
+            START_TIMER(sput)
+            for (size_t i = 0; i < n; i++) {
+                ref_put(keys[i], (long)i);
+            }
+            STOP_TIMER(sput)
+            START_TIMER(sget)
+            for (size_t i = 0; i < n; i++) {
+                check -= ref_get(keys[i]);
+            }
+            STOP_TIMER(sget)
+            printf("%10lu  %-6s  %10.4f  %10.4f  %12.1f  %12.1f  %10.1f\n",
+                    (unsigned long)n, "sorted", GET_TIMER(sput), GET_TIMER(sget),
+                    GET_TIMER(sput) * 1e9 / n, GET_TIMER(sget) * 1e9 / n,
+                    n * sizeof(struct ref_pair) / 1048576.0);
+            free(ref_pairs);
+            if (check != 0) {
+                printf("ERROR: tables disagree\n");
+            }
+        } else {
+            printf("%10lu  %-6s  %10s\n", (unsigned long)n, "sorted", "skipped");
+        }
+
+        free(keys);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/**
+ * bench_threads.c
+ *
+ * CS 470 Project 4
+ *
+ * Client thread scaling benchmark for the DHT (message backend). For each
+ * thread count given, every process starts that many threads, and each
+ * thread puts and then gets its own share of random keys; process 0 reports
+ * the aggregate rate of each phase. DHT options come from the environment
+ * (see dht.h).
+ *
+ * Usage: bench_threads <ops-per-thread> [threads...]
+ */
+
+#include <mpi.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dht.h"
+
+#define MAX_THREADS 64
+
+struct client {
+    pthread_t thread;
+    char (*keys)[16];
+    long ops;
+    long found;
+};
+
+static void *put_keys(void *arg)
+{
+    struct client *c = arg;
+    for (long i = 0; i < c->ops; i++) {
+        dht_put(c->keys[i], i);
+    }
+    return NULL;
+}
+
+static void *get_keys(void *arg)
+{
+    struct client *c = arg;
+    c->found = 0;
+    for (long i = 0; i < c->ops; i++) {
+        c->found += dht_get(c->keys[i]) != KEY_NOT_FOUND;
+    }
+    return NULL;
+}
+
+/*
+ * Helper function: runs one phase on every client thread and returns its
+ * time on the slowest process
+ */
+static double run_phase(struct client *clients, int threads, void *(*phase)(void *))
+{
+    MPI_Barrier(MPI_COMM_WORLD);
+    double time = MPI_Wtime();
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&clients[t].thread, NULL, phase, &clients[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(clients[t].thread, NULL);
+    }
+    dht_sync();
+    time = MPI_Wtime() - time;
+    double max_time;
+    MPI_Allreduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return max_time;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("Usage: %s <ops-per-thread> [threads...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    long ops = strtol(argv[1], NULL, 10);
+
+    struct dht_options opts;
+    dht_default_options(&opts);
+    int pid = dht_init_opts(&opts);
+    int nprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    int default_counts[] = { 1, 2, 4, 8 };
+    int *counts = default_counts;
+    int ncounts = 4;
+    if (argc > 2) {
+        ncounts = argc - 2;
+        counts = malloc(ncounts * sizeof(int));
+        for (int i = 0; i < ncounts; i++) {
+            counts[i] = (int)strtol(argv[i+2], NULL, 10);
+            if (counts[i] < 1 || counts[i] > MAX_THREADS) {
+                printf("ERROR: thread counts must be between 1 and %d\n", MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // pre-generate every thread's keys so only DHT calls are timed
+    struct client clients[MAX_THREADS];
+    for (int t = 0; t < MAX_THREADS; t++) {
+        clients[t].keys = NULL;
+    }
+    for (int i = 0; i < ncounts; i++) {
+        for (int t = 0; t < counts[i]; t++) {
+            if (clients[t].keys != NULL) {
+                continue;
+            }
+            clients[t].keys = malloc(ops * sizeof(*clients[t].keys));
+            clients[t].ops = ops;
+            unsigned seed = 12345 + 7919 * (unsigned)pid + 104729 * (unsigned)t;
+            for (long k = 0; k < ops; k++) {
+                seed = 1664525u * seed + 1013904223u;
+                snprintf(clients[t].keys[k], sizeof(clients[t].keys[k]), "key%u", seed % 1000000);
+            }
+        }
+    }
+
+    for (int i = 0; i < ncounts; i++) {
+        int threads = counts[i];
+        double put_time = run_phase(clients, threads, put_keys);
+        double get_time = run_phase(clients, threads, get_keys);
+        if (pid == 0) {
+            double total = (double)ops * threads * nprocs;
+            printf("procs=%d threads=%2d servers=%d async=%d  put: %10.0f ops/s  get: %10.0f ops/s\n",
+                    nprocs, threads, opts.server_threads, (int)opts.async_put,
+                    total / put_time, total / get_time);
+        }
+        for (int t = 0; t < threads; t++) {
+            if (clients[t].found != ops) {
+                printf("ERROR: process %d thread %d found %ld of %ld keys\n",
+                        pid, t, clients[t].found, ops);
+            }
+        }
+    }
+
+    FILE *null_out = fopen("/dev/null", "w");
+    dht_destroy(null_out);
+    fclose(null_out);
+    for (int t = 0; t < MAX_THREADS; t++) {
+        free(clients[t].keys);
+    }
+    if (counts != default_counts) {
+        free(counts);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+/**
+ * bench_trace.c
+ *
+ * CS 470 Project 4
+ *
+ * Trace-driven benchmark for the DHT. The trace (e.g. from gen_trace) is
+ * compiled with the replay engine so only DHT calls are timed; every put and
+ * get is timed individually into a log-scale latency histogram. Process 0
+ * reports the throughput of every process and the p50/p99/p999 latency of
+ * puts and gets over all processes. DHT options come from the environment
+ * (see dht.h); with DHT_HOT_THRESHOLD set, the share of gets answered by
+ * hot-key replicas instead of their owners is reported too.
+ *
+ * Usage: bench_trace <trace-file>
+ */
+
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dht.h"
+#include "replay.h"
+#include "wire.h"
+
+// Histogram buckets per power of two of nanoseconds, and powers covered
+#define SUB_BUCKETS 8
+#define BUCKETS (40 * SUB_BUCKETS)
+
+/*
+ * Helper function: histogram bucket of a latency in seconds
+ */
+static int bucket(double seconds)
+{
+    double ns = seconds * 1e9;
+    if (ns < 1.0) {
+        return 0;
+    }
+    int b = (int)(log2(ns) * SUB_BUCKETS);
+    return b < BUCKETS ? b : BUCKETS-1;
+}
+
+/*
+ * Helper function: latency in microseconds at a quantile of a histogram (the
+ * upper bound of the bucket it falls in)
+ */
+static double quantile(const unsigned long *hist, double q)
+{
+    unsigned long total = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    unsigned long rank = (unsigned long)ceil(q * total);
+    unsigned long seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= rank) {
+            return exp2((double)(b+1) / SUB_BUCKETS) / 1e3;
+        }
+    }
+    return exp2((double)BUCKETS / SUB_BUCKETS) / 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        printf("Usage: %s <trace-file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct dht_options opts;
+    dht_default_options(&opts);
+    int pid = dht_init_opts(&opts);
+    int nprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    struct replay replay;
+    if (!replay_compile(argv[1], pid, &replay)) {
+        printf("ERROR: Could not open file \"%s\"\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // [0] puts, [1] gets
+    unsigned long *hist = calloc(2 * BUCKETS, sizeof(unsigned long));
+    unsigned long ops = 0;
+    bool synced = false;
+
+    dht_sync();
+    double run_time = MPI_Wtime();
+    struct wire_record rec;
+    size_t pos = 0;
+    size_t used;
+    while ((used = wire_unpack(replay.ops + pos, replay.bytes - pos, &rec)) > 0) {
+        pos += used;
+        double start = MPI_Wtime();
+        switch (rec.op) {
+            case WIRE_PUT:
+                dht_put(rec.key, rec.value);
+                hist[bucket(MPI_Wtime() - start)]++;
+                ops++;
+                break;
+            case WIRE_GET:
+                dht_get(rec.key);
+                hist[BUCKETS + bucket(MPI_Wtime() - start)]++;
+                ops++;
+                break;
+            case REPLAY_SIZE:
+                dht_size();
+                break;
+            case REPLAY_SYNC:
+                if (!synced) {
+                    dht_sync();
+                    synced = true;
+                }
+                break;
+        }
+    }
+    if (!synced) {
+        dht_sync();
+    }
+    run_time = MPI_Wtime() - run_time;
+
+    // every process has its replies before any leaves the DHT (the trace
+    // may end with a size after its sync)
+    dht_sync();
+
+    // gather per-process rates and merge the histograms
+    double rate = ops / run_time;
+    double *rates = pid == 0 ? malloc(nprocs * sizeof(double)) : NULL;
+    MPI_Gather(&rate, 1, MPI_DOUBLE, rates, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    unsigned long *total_hist = pid == 0 ? malloc(2 * BUCKETS * sizeof(unsigned long)) : NULL;
+    MPI_Reduce(hist, total_hist, 2 * BUCKETS, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    struct replica_stats stats;
+    dht_replica_stats(&stats);
+    unsigned long counts[3] = { stats.hits, stats.pushed, stats.invalidations };
+    unsigned long total_counts[3];
+    MPI_Reduce(counts, total_counts, 3, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (pid == 0) {
+        double sum = 0.0;
+        printf("procs=%d backend=%s servers=%d async=%d\n", nprocs,
+                opts.backend == DHT_BACKEND_RMA ? (opts.shm ? "rma+shm" : "rma") :
+                opts.progress ? "progress" : "message",
+                opts.server_threads, (int)opts.async_put);
+        for (int p = 0; p < nprocs; p++) {
+            printf("  rank %3d: %10.0f ops/s\n", p, rates[p]);
+            sum += rates[p];
+        }
+        printf("  total:    %10.0f ops/s\n", sum);
+        const char *names[2] = { "put", "get" };
+        for (int i = 0; i < 2; i++) {
+            const unsigned long *h = total_hist + i * BUCKETS;
+            printf("  %s latency (us): p50 %8.2f  p99 %8.2f  p999 %8.2f\n", names[i],
+                    quantile(h, 0.50), quantile(h, 0.99), quantile(h, 0.999));
+        }
+        if (opts.hot_threshold > 0) {
+            unsigned long gets = 0;
+            for (int b = 0; b < BUCKETS; b++) {
+                gets += total_hist[BUCKETS + b];
+            }
+            printf("  hot keys: %5.1f%% of gets shed to replicas"
+                    "  (%lu replicas sent, %lu invalidated)\n",
+                    100.0 * total_counts[0] / (gets + 1e-9), total_counts[1], total_counts[2]);
+        }
+        free(rates);
+        free(total_hist);
+    }
+
+    free(hist);
+    replay_free(&replay);
+    FILE *null_out = fopen("/dev/null", "w");
+    dht_destroy(null_out);
+    fclose(null_out);
+    return EXIT_SUCCESS;
+}
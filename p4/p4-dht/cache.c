@@ -0,0 +1,129 @@
+/**
+ * cache.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the client-side LRU read cache (see cache.h), on a
+ * keystore. Writes and invalidations are recorded in the keystore's guard
+ * words, which nothing evicts: each holds the stamp of the last change to
+ * any key in its slot.
+ */
+
+#include <pthread.h>
+
+#include "cache.h"
+#include "keystore.h"
+
+static struct keystore store;
+static unsigned long stamp;     // stamps handed out so far
+static struct cache_stats stats;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void cache_init(size_t size)
+{
+    cache_destroy();
+    pthread_mutex_lock(&cache_lock);
+    keystore_init(&store, size, true);
+    stamp = 0;
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&cache_lock);
+}
+
+bool cache_lookup(const char *key, long *value)
+{
+    bool hit = false;
+    pthread_mutex_lock(&cache_lock);
+    if (store.capacity > 0) {
+        size_t e = keystore_find(&store, key);
+        if (e != KEYSTORE_NONE && store.entries[e].valid) {
+            *value = store.entries[e].value;
+            keystore_touch(&store, e);
+            hit = true;
+        }
+        if (hit) {
+            stats.hits++;
+        } else {
+            stats.misses++;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return hit;
+}
+
+unsigned long cache_stamp()
+{
+    pthread_mutex_lock(&cache_lock);
+    unsigned long now = stamp;
+    pthread_mutex_unlock(&cache_lock);
+    return now;
+}
+
+void cache_insert(const char *key, long value, unsigned long version, unsigned long since)
+{
+    pthread_mutex_lock(&cache_lock);
+    // a write of this process's own or an invalidation that the reply may
+    // predate wins
+    if (store.capacity > 0 && *keystore_guard(&store, key) <= since) {
+        size_t e = keystore_find(&store, key);
+        if (e == KEYSTORE_NONE) {
+            e = keystore_add(&store, key);
+        }
+        // and so does a newer value already cached
+        struct keystore_entry *entry = &store.entries[e];
+        if (version >= entry->version) {
+            entry->value = value;
+            entry->version = version;
+            entry->valid = true;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_invalidate(const char *key, unsigned long version)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (store.capacity > 0) {
+        size_t e = keystore_find(&store, key);
+        if (e != KEYSTORE_NONE && store.entries[e].valid && store.entries[e].version < version) {
+            store.entries[e].valid = false;
+            stats.invalidations++;
+        }
+        *keystore_guard(&store, key) = ++stamp;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_remove(const char *key)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (store.capacity > 0) {
+        size_t e = keystore_find(&store, key);
+        if (e != KEYSTORE_NONE) {
+            store.entries[e].valid = false;
+        }
+        *keystore_guard(&store, key) = ++stamp;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_clear()
+{
+    pthread_mutex_lock(&cache_lock);
+    keystore_clear(&store);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_get_stats(struct cache_stats *out)
+{
+    pthread_mutex_lock(&cache_lock);
+    *out = stats;
+    out->evictions = store.evictions;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_destroy()
+{
+    pthread_mutex_lock(&cache_lock);
+    keystore_destroy(&store);
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,64 @@
+/**
+ * cache.h
+ *
+ * CS 470 Project 4
+ *
+ * Client-side read cache for remote DHT values. A fixed number of entries is
+ * kept in least-recently-used order; each entry carries the version its
+ * owner stamped on the value. All functions are safe to call from several
+ * threads at once.
+ */
+
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include "local.h"
+
+/*
+ * Cache counters
+ */
+struct cache_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long invalidations;    // entries dropped by an owner's update
+    unsigned long evictions;        // entries dropped to make room
+};
+
+void cache_init(size_t capacity);
+
+/*
+ * Look up a key; returns true and sets *value on a hit
+ */
+bool cache_lookup(const char *key, long *value);
+
+/*
+ * Stamp to pass to cache_insert for a get that starts now
+ */
+unsigned long cache_stamp();
+
+/*
+ * Remember a value fetched from its owner by a get that started at stamp
+ * since. Ignored if a newer value is cached, or if this process has written
+ * the key or had it invalidated since the get started. Those changes are
+ * remembered by hash slot, so a change to another key in the same slot also
+ * keeps the reply out (it is only not cached).
+ */
+void cache_insert(const char *key, long value, unsigned long version, unsigned long since);
+
+/*
+ * Drop a key whose owner has stored a new version. Replies to gets that
+ * started before the invalidation arrived are not cached.
+ */
+void cache_invalidate(const char *key, unsigned long version);
+
+/*
+ * Drop a key this process is writing. Replies to gets that started before
+ * the write are not cached.
+ */
+void cache_remove(const char *key);
+
+void cache_clear();
+void cache_get_stats(struct cache_stats *stats);
+void cache_destroy();
+
+#endif
@@ -1,293 +1,2937 @@
-/**
- * dht.c
- *
- * CS 470 Project 4
- *
- * Implementation for distributed hash table (DHT).
- *
- * Name: Brendan Pho, Emma Magner 
- */
-
-#include <mpi.h>
-#include <pthread.h>
-#include "dht.h"
-
-// Message tags for the server
-#define PUT 1
-#define GET 2
-#define CONFIRM 3
-#define SIZE 5
-#define DESTROY 6
-
-// Message tags for the client
-#define RETURN_VALUE 10
-#define TOTAL_SIZE 6
-
-// Proces ID, process rank, number of processes
-static int pid;
-int rank;
-int nprocs;
-
-// Condition for the while loop regarding locks and unlocks
-int approved;
-
-// Pthread variables/mutexes
-pthread_mutex_t approve_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t approve_cond = PTHREAD_COND_INITIALIZER;
-pthread_t threadid;
-
-
-// Represents a message being sent between client and server
-struct dht_msg
-{
-    char key[MAX_KEYLEN];
-    long value;
-};
-
-
-// Creates a zeroed out "blank" message
-struct dht_msg blank()
-{
-    struct dht_msg msg;
-    memset(&msg, 0, sizeof(struct dht_msg));
-    return msg;
-}
-
-
-// Receives a message with the given tag from any source
-void recv_tag(struct dht_msg *msg, int tag, MPI_Status *recv_status)
-{
-    MPI_Recv(msg, sizeof(struct dht_msg), MPI_BYTE, MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, recv_status);
-}
-
-/*
-Processes all messages with server tags and by using the source and tag, the server will choose to accept the message in MPI_Recv
-*/
-void *server(void *ptr)
-{
-    // This loop will continue until it receives a message DESTROY
-    while(1) {
-        MPI_Status status;
-        MPI_Status recv_status;
-        struct dht_msg msg = blank();
-        
-        // Looks at the messages for the status, source, and tag
-        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        
-        switch (status.MPI_TAG)
-        {
-            case PUT:
-                recv_tag(&msg, PUT, &recv_status);
-                MPI_Request req;
-                local_put(msg.key, msg.value);
-            
-            struct dht_msg ret_msg = blank();
-            ret_msg.value = CONFIRM; 
-            
-            // Stops a bug that blocked when sending to own process
-            if (status.MPI_SOURCE != rank)
-            {   
-            MPI_Send(&ret_msg, sizeof(struct dht_msg), MPI_BYTE, status.MPI_SOURCE, CONFIRM, MPI_COMM_WORLD);
-            }
-            else 
-            {
-                MPI_Isend(&ret_msg, sizeof(struct dht_msg), MPI_BYTE, status.MPI_SOURCE, CONFIRM, MPI_COMM_WORLD, &req);
-            }
-            break;
-            case GET:
-
-                recv_tag(&msg, GET, &recv_status);
-                MPI_Request request;
-
-                // Prepares a new message with the value received
-                long val = local_get(msg.key);
-                struct dht_msg get_value = blank();
-                get_value.value = val;
-
-                // Stops a bug that blocked when sending to own process
-                if (status.MPI_SOURCE != rank)
-                {
-                    MPI_Send(&get_value, sizeof(struct dht_msg), MPI_BYTE, status.MPI_SOURCE, RETURN_VALUE, MPI_COMM_WORLD);
-                }
-                else
-                {
-                    MPI_Isend(&get_value, sizeof(struct dht_msg), MPI_BYTE, status.MPI_SOURCE, RETURN_VALUE, MPI_COMM_WORLD, &request);
-                }
-            break;
-            case CONFIRM:
-
-                // Receives a message of a approval from PUT and signals the client
-                recv_tag(&msg, CONFIRM, &recv_status);
-                approved = 1;
-                pthread_mutex_unlock(&approve_lock);
-                pthread_cond_signal(&approve_cond);
-            
-                break;
-            case SIZE:
-
-                // A request for the size of the hash table is received and all process will give their size through MPI_REDUCE
-                // The final result is sent to the client
-                recv_tag(&msg, SIZE, &recv_status);
-                long localsize = 0;
-                localsize = local_size();
-                long totalsize = 0;
-                MPI_Reduce(&localsize, &totalsize, 1, MPI_LONG, MPI_SUM, recv_status.MPI_SOURCE, MPI_COMM_WORLD);
-                if (rank == recv_status.MPI_SOURCE)
-                {
-                    MPI_Send(&totalsize, 1, MPI_LONG, recv_status.MPI_SOURCE, TOTAL_SIZE, MPI_COMM_WORLD);
-                }
-            case DESTROY:
-
-                // Message DESTROY is received so loop and server terminates
-                recv_tag(&msg, DESTROY, &recv_status);
-                pthread_exit(NULL);
-                break;
-            default:
-
-                break;
-        
-        } // end switch case
-    }
-}
-
-/**
- * Given hash function for this project
- */
-int hash(const char *name) 
-{
-  unsigned hash = 5381;
-  while (*name != '\0')
-  {
-    hash = ((hash << 5) + hash) + (unsigned)(*name++);
-  }
-  return hash % nprocs;
-}
-
-int dht_init()
-{
-    int provided;
-    
-    MPI_Init_thread(NULL, NULL, MPI_THREAD_MULTIPLE, &provided);
-    if (provided != MPI_THREAD_MULTIPLE) 
-    {
-      printf("ERROR: Cannot initialize MPI in THREAD_MULTIPLE mode.\n");
-      exit(EXIT_FAILURE);
-    }
-    
-    // Set the rank and number of processes
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
-
-    // Approval flag where 0 is not approved and 1 is approved
-    approved = 0;
-
-    local_init();
-    
-    // Process ID is the process's rank
-    pid = rank;
-
-    // Create server thread
-    pthread_create(&threadid, NULL, server, NULL);
-    return pid;
-}
-
-void put_send(int dest, const char *key, long value)
-{
-    struct dht_msg msg = blank();
-
-    // Put the new key and value into the blank message
-    strcpy(msg.key, key);
-    msg.value = value;
-    
-    // Send message to server 
-    MPI_Send(&msg, sizeof(struct dht_msg), MPI_BYTE, dest, PUT, MPI_COMM_WORLD);
-}
-
-void dht_put(const char *key, long value)
-{
-    // Destination for the key and value
-    int dest = hash(key);
-
-    // Send the key and value
-    put_send(dest, key, value);
-
-    // Lock until the approved flag is 1
-    pthread_mutex_lock(&approve_lock);
-    while (!approved)
-    {
-        pthread_cond_wait(&approve_cond, &approve_lock);
-    }
-
-    // Set approved to unconfirmed.
-    approved = 0;
-
-    pthread_mutex_unlock(&approve_lock);
-}
-
-long get_send(int source, const char *key)
-{
-    MPI_Status status;
-
-    // Blank messages to send and receive
-    struct dht_msg msg = blank();
-    struct dht_msg ret_msg = blank();
-    
-    // Put key into message
-    strcpy(msg.key, key);
-
-    // Send a request for value
-    MPI_Sendrecv(&msg, sizeof(struct dht_msg), MPI_BYTE, source, GET,
-                 &ret_msg, sizeof(struct dht_msg), MPI_BYTE, source, RETURN_VALUE, MPI_COMM_WORLD, &status);
-    return ret_msg.value;
-}
-
-long dht_get(const char *key)
-{
-    // Source of the key
-    int source = hash(key);
-    // Send the key
-    long value = get_send(source, key);
-
-    // Value at the key
-    return value;
-}
-
-size_t dht_size()
-{
-    int size = 0;
-    // Requests for wait
-    MPI_Request reqs[nprocs];
-    struct dht_msg msg = blank();
-    // All threads get requested for their size
-    for (int i = 0; i < nprocs; i++) 
-    {
-        MPI_Isend(&msg, sizeof(struct dht_msg), MPI_BYTE, i, SIZE, MPI_COMM_WORLD, &reqs[i]);
-    }
-    // All sends need to complete before receive
-    MPI_Waitall(nprocs, reqs, MPI_STATUSES_IGNORE);
-    
-    // Receive total
-    MPI_Status status;
-    MPI_Recv(&size, 1, MPI_LONG, rank, TOTAL_SIZE, MPI_COMM_WORLD, &status);
-    return size;
-}
-
-void dht_sync()
-{
-    // All clients wait until all clients sync
-    MPI_Barrier(MPI_COMM_WORLD);
-}
-
-void dht_destroy(FILE *output)
-{
-    // Wait for all threads
-    dht_sync();
-    MPI_Request req;
-    local_destroy(output);
-    struct dht_msg msg = blank();
-    // Sends a message that the server thread is terminating
-    MPI_Isend(&msg, sizeof(struct dht_msg), MPI_BYTE, rank, DESTROY, MPI_COMM_WORLD, &req);
-    pthread_join(threadid, NULL);
-    // Clean up
-    MPI_Finalize();
-}
+/**
+ * dht.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation for distributed hash table (DHT).
+ *
+ * Name: Brendan Pho, Emma Magner
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <limits.h>
+#include <mpi.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dht.h"
+#include "dump.h"
+#include "locality.h"
+#include "metrics.h"
+#include "range.h"
+#include "replica.h"
+#include "rma.h"
+#include "sketch.h"
+#include "snapshot.h"
+#include "wire.h"
+
+// Message tags for the server (sent on the communicator of the worker that
+// owns the key's shard)
+#define PUT 1
+#define GET 2
+#define PUT_BATCH 4
+#define SIZE 5
+#define DESTROY 6
+#define BATCH_CONFIRM 7
+#define GET_MANY 8
+#define INVALIDATE 9
+#define INVALIDATE_ACK 12
+#define UPDATE 13
+#define REPLICATE 14
+#define SCAN 15
+
+// Message tags for the client (sent on reply_comm)
+#define RETURN_VALUE 10
+#define TOTAL_SIZE 11
+
+// Every request a client waits on names a reply tag of its own from this
+// range, so any number of requests and client threads can be in flight
+#define REQUEST_TAG_BASE 1024
+#define REQUEST_TAGS 16384
+
+// Receives each server worker keeps posted
+#define RECVS_PER_WORKER 4
+
+// Batched requests a client keeps in flight at once
+#define MAX_INFLIGHT 64
+
+// Idle polls before a server worker starts sleeping between polls
+#define SPIN_POLLS 1000
+
+// Keys each process contributes, on average, to the sample that range
+// splitters are chosen from
+#define RANGE_OVERSAMPLE 64
+
+// Size of each worker's hot-key sketch, and gets between halvings of it
+#define SKETCH_WIDTH 4096
+#define SKETCH_WINDOW 65536
+
+// Proces ID, process rank, number of processes
+static int pid;
+int rank;
+int nprocs;
+
+// Options chosen at dht_init
+static struct dht_options options;
+
+// Placement ring (DHT_PLACEMENT_RING)
+static struct ring ring;
+
+// Key space slices (DHT_PLACEMENT_RANGE), and whether they have been chosen
+// from a sample of keys yet. Until then keys are placed by hash: the initial
+// cut by leading characters would put keys that share a prefix on one process.
+static struct range ranges;
+static bool ranges_chosen;
+
+// Replies that the client thread receives directly travel on their own
+// communicator so the servers never see them
+static MPI_Comm reply_comm;
+
+// Number of put batches sent to each rank that have not been confirmed yet
+// (protected by approve_lock)
+static int *pending_batches;
+
+// Invalidations and replicas this process's workers have sent that have not
+// been acknowledged yet (protected by approve_lock)
+static int pending_invalidations;
+
+// Pthread variables/mutexes
+pthread_mutex_t approve_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t approve_cond = PTHREAD_COND_INITIALIZER;
+
+
+// One server worker thread. Each worker serves a fixed subset of the local
+// table's shards and has its own communicator, so all requests for a key go
+// to the same worker (and are handled in the order they were sent) while
+// different workers never touch the same shard.
+struct worker
+{
+    int id;
+    MPI_Comm comm;                          // requests for this worker
+    MPI_Request reqs[RECVS_PER_WORKER];     // persistent receives
+    char *bufs[RECVS_PER_WORKER];           // one buffer per receive
+    int next;                               // oldest posted receive
+    MPI_Request *sends;                     // invalidations still being sent
+    char **send_bufs;
+    int send_count;
+    int send_cap;
+    struct sketch sketch;                   // gets per key (hot-key mode)
+    pthread_t thread;
+};
+
+static struct worker *workers;
+
+// Puts buffered for one owner rank and worker (asynchronous put mode), packed
+// as wire records. Two buffers are used so one can fill while the other is
+// still being sent.
+struct put_buffer
+{
+    char *data;                 // batch being filled
+    size_t used;                // bytes used in data
+    size_t count;               // number of puts in data
+    char *inflight;             // batch being sent
+    MPI_Request req;            // send request for inflight
+};
+
+static struct put_buffer *put_buffers;
+
+// Bytes reserved for one put batch
+static size_t put_batch_bytes;
+
+// A get or put in flight (see dht_iget). Requests that can be answered on
+// the spot (local keys, cache hits, buffered puts, the RMA backend) are
+// complete as soon as they are made and take no reply tag.
+struct dht_request
+{
+    MPI_Request reqs[2];        // reply receive, request send
+    char msg[2 * WIRE_MAX_RECORD];
+    long reply[2];              // value and version (gets)
+    long *value_out;            // where a get's value goes
+    char key[MAX_KEYLEN];       // key of a get whose value will be cached
+    bool cache;
+    unsigned long stamp;        // cache_stamp() when that get started
+    int tag;                    // reply tag, or -1 if none is held
+    pthread_t owner;            // thread that made the request
+    bool done;
+};
+
+// Reply tags not held by anyone, and the request holding each tag (NULL for
+// tags held by a blocking call); protected by request_lock, and tag_cond is
+// signalled whenever a tag is released. Tags are what keep replies to
+// different threads apart, so every operation that waits for a reply from a
+// server takes one.
+static int *free_tags;
+static int free_tag_count;
+static struct dht_request **inflight;
+static pthread_mutex_t request_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tag_cond = PTHREAD_COND_INITIALIZER;
+
+// Protects the put buffers (asynchronous put mode)
+static pthread_mutex_t put_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Records a message this process sent to a server as a client
+static void count_send(size_t bytes)
+{
+    metrics_add(METRIC_CLIENT_MESSAGES, 1);
+    metrics_add(METRIC_CLIENT_BYTES_SENT, bytes);
+}
+
+// Records time a client spent blocked, since start, waiting for replies
+// (METRIC_REPLY_WAIT_NS) or confirmations (METRIC_CONFIRM_WAIT_NS)
+static void count_wait(int metric, unsigned long start)
+{
+    metrics_add(metric, metrics_now_ns() - start);
+    metrics_add(metric == METRIC_REPLY_WAIT_NS ? METRIC_REPLY_WAITS : METRIC_CONFIRM_WAITS, 1);
+}
+
+// Counts an operation on a key this process owns by the process it came
+// from, so the key can migrate to its dominant accessor
+static void count_access(const char *key, int accessor)
+{
+    if (options.migrate_threshold > 0)
+    {
+        locality_record(key, accessor);
+    }
+}
+
+// Counts an operation a client of this process applied to its own table
+static void count_local(const char *key)
+{
+    metrics_add(METRIC_LOCAL_OPS, 1);
+    count_access(key, rank);
+}
+
+// Worker that serves a key on every rank
+static int worker_for(const char *key)
+{
+    return local_shard(key) % options.server_threads;
+}
+
+// Waits a little longer each time a worker finds nothing to do, so an idle
+// server does not keep a core busy
+static void backoff(int *idle)
+{
+    if (++(*idle) > SPIN_POLLS)
+    {
+        struct timespec pause = { 0, 50000 };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Sends a message from a worker without blocking; the worker owns buf until
+// reap_sends finds the send complete. Workers never block on each other (or
+// on a client reading a scan) this way, however many invalidations cross
+// between processes.
+static void worker_isend(struct worker *w, char *buf, int bytes, int dest, int tag, MPI_Comm comm)
+{
+    if (w->send_count == w->send_cap)
+    {
+        w->send_cap = w->send_cap == 0 ? 16 : w->send_cap * 2;
+        w->sends = realloc(w->sends, w->send_cap * sizeof(MPI_Request));
+        w->send_bufs = realloc(w->send_bufs, w->send_cap * sizeof(char *));
+    }
+    MPI_Isend(buf, bytes, MPI_BYTE, dest, tag, comm, &w->sends[w->send_count]);
+    w->send_bufs[w->send_count++] = buf;
+    metrics_add(METRIC_SERVER_BYTES_SENT, bytes);
+}
+
+// Sends a server's reply of count values (an empty confirmation if count is
+// zero)
+static void server_reply(const long *values, int count, int dest, int tag, MPI_Comm comm)
+{
+    if (count == 0)
+    {
+        MPI_Send(NULL, 0, MPI_BYTE, dest, tag, comm);
+    }
+    else
+    {
+        MPI_Send(values, count, MPI_LONG, dest, tag, comm);
+    }
+    metrics_add(METRIC_SERVER_BYTES_SENT, count * sizeof(long));
+}
+
+// Frees the buffers of a worker's completed sends (all of them if wait is set)
+static void reap_sends(struct worker *w, bool wait)
+{
+    int i = 0;
+    while (i < w->send_count)
+    {
+        int done = 1;
+        if (wait)
+        {
+            MPI_Wait(&w->sends[i], MPI_STATUS_IGNORE);
+        }
+        else
+        {
+            MPI_Test(&w->sends[i], &done, MPI_STATUS_IGNORE);
+        }
+        if (done)
+        {
+            free(w->send_bufs[i]);
+            w->send_count--;
+            w->sends[i] = w->sends[w->send_count];
+            w->send_bufs[i] = w->send_bufs[w->send_count];
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+// Tells the other processes in sharers (a set of LOCAL_SHARER bits) that
+// the values they cached for records (packed WIRE_INVALIDATE records, bytes
+// long) have changed. Called by the owner's worker, or by the client itself
+// (w == NULL) for keys it owns.
+static void send_invalidations(struct worker *w, int worker_id, const char *records, size_t bytes, uint64_t sharers)
+{
+    if (bytes == 0)
+    {
+        return;
+    }
+    int sends = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        if (i != rank && (sharers & LOCAL_SHARER(i)) != 0)
+        {
+            sends++;
+        }
+    }
+    pthread_mutex_lock(&approve_lock);
+    pending_invalidations += sends;
+    pthread_mutex_unlock(&approve_lock);
+
+    for (int i = 0; i < nprocs; i++)
+    {
+        if (i == rank || (sharers & LOCAL_SHARER(i)) == 0)
+        {
+            continue;
+        }
+        if (w == NULL)
+        {
+            MPI_Send(records, bytes, MPI_BYTE, i, INVALIDATE, workers[worker_id].comm);
+            count_send(bytes);
+        }
+        else
+        {
+            char *copy = malloc(bytes);
+            memcpy(copy, records, bytes);
+            worker_isend(w, copy, bytes, i, INVALIDATE, w->comm);
+        }
+    }
+}
+
+// Do owners tell other processes when a value they handed out changes?
+static bool push_invalidations()
+{
+    return options.cache_invalidation == DHT_CACHE_PUSH || options.hot_threshold > 0;
+}
+
+// Counts a get of a key this process owns and, once the key is hot, sends
+// its value to every other process as a read-only replica
+static void count_get(struct worker *w, const char *key)
+{
+    if (options.hot_threshold == 0 || nprocs == 1 ||
+            sketch_add(&w->sketch, key) < (uint32_t)options.hot_threshold)
+    {
+        return;
+    }
+
+    // Mark the pair as shared with everyone so the next put invalidates the
+    // replicas
+    unsigned long version;
+    long value = local_get_version(key, &version, ~(uint64_t)0);
+    if (version == 0)
+    {
+        return;     // missing keys are not replicated
+    }
+    char rec[WIRE_MAX_RECORD];
+    size_t bytes = wire_pack_expected(rec, WIRE_REPLICA, key, value, (long)version);
+    pthread_mutex_lock(&approve_lock);
+    pending_invalidations += nprocs - 1;
+    pthread_mutex_unlock(&approve_lock);
+    for (int i = 0; i < nprocs; i++)
+    {
+        if (i != rank)
+        {
+            char *copy = malloc(bytes);
+            memcpy(copy, rec, bytes);
+            worker_isend(w, copy, bytes, i, REPLICATE, w->comm);
+        }
+    }
+    replica_count_pushed(nprocs - 1);
+
+    // It takes as many gets again to replicate the key after its next put
+    sketch_forget(&w->sketch, key, (uint32_t)options.hot_threshold);
+}
+
+// Stores a put made on this process and returns how many bytes of
+// invalidation record it appended to inval (zero unless a remote cache may
+// hold the old value and invalidations are pushed); the processes that may
+// hold it are added to *sharers
+static size_t apply_put(const char *key, long value, char *inval, uint64_t *sharers)
+{
+    unsigned long version;
+    uint64_t cached_by = local_put_version(key, value, &version);
+    if (cached_by == 0 || !push_invalidations())
+    {
+        return 0;
+    }
+    *sharers |= cached_by;
+    return wire_pack(inval, WIRE_INVALIDATE, key, WIRE_HAS_VALUE, (long)version);
+}
+
+// Applies an atomic update record (WIRE_ADD, WIRE_CAS or WIRE_MAX) made on
+// this process; sets *result and returns the invalidation bytes as apply_put
+static size_t apply_update(const struct wire_record *rec, long *result, char *inval, uint64_t *sharers)
+{
+    int op = rec->op == WIRE_ADD ? LOCAL_ADD : rec->op == WIRE_CAS ? LOCAL_CAS : LOCAL_MAX;
+    unsigned long version;
+    uint64_t cached_by;
+    *result = local_update(rec->key, op, rec->value, rec->expected, &version, &cached_by);
+    if (cached_by == 0 || !push_invalidations())
+    {
+        return 0;
+    }
+    *sharers |= cached_by;
+    return wire_pack(inval, WIRE_INVALIDATE, rec->key, WIRE_HAS_VALUE, (long)version);
+}
+
+// Streams the pairs of this process that match scan to a client, in key
+// order, as messages of WIRE_PUT records; an empty message ends them
+static void send_scan(struct worker *w, const struct local_scan *scan, int dest, int tag)
+{
+    size_t count;
+    struct snapshot_pair *pairs = local_scan(scan, &count);
+    size_t i = 0;
+    while (i < count)
+    {
+        char *chunk = malloc(WIRE_MAX_MESSAGE);
+        size_t used = 0;
+        while (i < count && used + WIRE_MAX_RECORD <= WIRE_MAX_MESSAGE)
+        {
+            used += wire_pack(chunk + used, WIRE_PUT, pairs[i].key, WIRE_HAS_VALUE, (long)pairs[i].value);
+            i++;
+        }
+        worker_isend(w, chunk, used, dest, tag, reply_comm);
+    }
+    worker_isend(w, NULL, 0, dest, tag, reply_comm);
+    free(pairs);
+}
+
+/*
+Handles one request that arrived at a worker. Returns false once the worker
+has been told to shut down.
+*/
+static bool handle_message(struct worker *w, char *buf, MPI_Status *status)
+{
+    struct wire_record rec;
+    int bytes;
+    MPI_Get_count(status, MPI_BYTE, &bytes);
+
+    switch (status->MPI_TAG)
+    {
+        case PUT:
+        case PUT_BATCH:
+        {
+            // One put led by the tag to confirm it with, or a whole batch of
+            // puts from one client; apply them all and confirm with a single
+            // empty message. Caches holding an old value are told before
+            // the confirmation goes out.
+            int reply_tag = -1;
+            char *inval = malloc(bytes / WIRE_HEADER_BYTES * WIRE_MAX_RECORD + 1);
+            size_t inval_bytes = 0;
+            uint64_t sharers = 0;
+            size_t offset = 0;
+            size_t used;
+            while ((used = wire_unpack(buf + offset, bytes - offset, &rec)) > 0)
+            {
+                if (rec.op == WIRE_REPLY_TAG)
+                {
+                    reply_tag = (int)rec.value;
+                }
+                else
+                {
+                    inval_bytes += apply_put(rec.key, rec.value, inval + inval_bytes, &sharers);
+                    count_access(rec.key, status->MPI_SOURCE);
+                }
+                offset += used;
+            }
+            send_invalidations(w, w->id, inval, inval_bytes, sharers);
+            free(inval);
+
+            if (status->MPI_TAG == PUT)
+            {
+                server_reply(NULL, 0, status->MPI_SOURCE, reply_tag, reply_comm);
+            }
+            else
+            {
+                server_reply(NULL, 0, status->MPI_SOURCE, BATCH_CONFIRM, w->comm);
+            }
+            break;
+        }
+        case GET:
+        {
+            // Replies with the value, followed by its version if the client
+            // is going to cache it, using the tag the request is led by
+            long reply[2] = { KEY_NOT_FOUND, 0 };
+            int count = 1;
+            int reply_tag = RETURN_VALUE;
+            size_t used = wire_unpack(buf, bytes, &rec);
+            if (used > 0 && rec.op == WIRE_REPLY_TAG)
+            {
+                reply_tag = (int)rec.value;
+                used = wire_unpack(buf + used, bytes - used, &rec);
+            }
+            if (used > 0)
+            {
+                unsigned long version;
+                bool share = (rec.flags & WIRE_WANT_VERSION) != 0;
+                reply[0] = local_get_version(rec.key, &version,
+                        share ? LOCAL_SHARER(status->MPI_SOURCE) : 0);
+                reply[1] = (long)version;
+                count = share ? 2 : 1;
+            }
+            server_reply(reply, count, status->MPI_SOURCE, reply_tag, reply_comm);
+            if (used > 0)
+            {
+                count_get(w, rec.key);
+                count_access(rec.key, status->MPI_SOURCE);
+            }
+            break;
+        }
+        case GET_MANY:
+        {
+            // A batch of keys from one client, led by the tag to reply with;
+            // look them all up and answer with one array of values in the
+            // same order
+            int count = 0;
+            int reply_tag = RETURN_VALUE;
+            long *values = malloc((bytes / WIRE_HEADER_BYTES + 1) * sizeof(long));
+            size_t offset = 0;
+            size_t used;
+            while ((used = wire_unpack(buf + offset, bytes - offset, &rec)) > 0)
+            {
+                if (rec.op == WIRE_REPLY_TAG)
+                {
+                    reply_tag = (int)rec.value;
+                }
+                else
+                {
+                    values[count++] = local_get(rec.key);
+                    count_get(w, rec.key);
+                    count_access(rec.key, status->MPI_SOURCE);
+                }
+                offset += used;
+            }
+
+            server_reply(values, count, status->MPI_SOURCE, reply_tag, reply_comm);
+            free(values);
+            break;
+        }
+        case UPDATE:
+        {
+            // One or more atomic updates from one client, optionally led by
+            // the tag to reply with; each is applied under its shard's lock,
+            // so updates from different clients never lose one another. The
+            // results go back as one array, after any invalidations.
+            int count = 0;
+            int reply_tag = RETURN_VALUE;
+            long *results = malloc((bytes / WIRE_HEADER_BYTES + 1) * sizeof(long));
+            char *inval = malloc(bytes / WIRE_HEADER_BYTES * WIRE_MAX_RECORD + 1);
+            size_t inval_bytes = 0;
+            uint64_t sharers = 0;
+            size_t offset = 0;
+            size_t used;
+            while ((used = wire_unpack(buf + offset, bytes - offset, &rec)) > 0)
+            {
+                if (rec.op == WIRE_REPLY_TAG)
+                {
+                    reply_tag = (int)rec.value;
+                }
+                else
+                {
+                    inval_bytes += apply_update(&rec, &results[count++], inval + inval_bytes, &sharers);
+                    count_access(rec.key, status->MPI_SOURCE);
+                }
+                offset += used;
+            }
+            send_invalidations(w, w->id, inval, inval_bytes, sharers);
+            free(inval);
+
+            server_reply(results, count, status->MPI_SOURCE, reply_tag, reply_comm);
+            free(results);
+            break;
+        }
+        case BATCH_CONFIRM:
+
+            // A put batch has been applied by its owner
+            pthread_mutex_lock(&approve_lock);
+            pending_batches[status->MPI_SOURCE]--;
+            pthread_cond_broadcast(&approve_cond);
+            pthread_mutex_unlock(&approve_lock);
+
+            break;
+        case INVALIDATE:
+        {
+            // The owner changed values this process may have cached
+            size_t offset = 0;
+            size_t used;
+            while ((used = wire_unpack(buf + offset, bytes - offset, &rec)) > 0)
+            {
+                cache_invalidate(rec.key, (unsigned long)rec.value);
+                replica_invalidate(rec.key, (unsigned long)rec.value);
+                offset += used;
+            }
+            server_reply(NULL, 0, status->MPI_SOURCE, INVALIDATE_ACK, w->comm);
+            break;
+        }
+        case REPLICATE:
+        {
+            // An owner's hot keys, to answer gets for until invalidated
+            size_t offset = 0;
+            size_t used;
+            while ((used = wire_unpack(buf + offset, bytes - offset, &rec)) > 0)
+            {
+                replica_insert(rec.key, rec.value, (unsigned long)rec.expected);
+                offset += used;
+            }
+            server_reply(NULL, 0, status->MPI_SOURCE, INVALIDATE_ACK, w->comm);
+            break;
+        }
+        case INVALIDATE_ACK:
+
+            // Another process has applied an invalidation or replica
+            pthread_mutex_lock(&approve_lock);
+            pending_invalidations--;
+            pthread_cond_broadcast(&approve_cond);
+            pthread_mutex_unlock(&approve_lock);
+
+            break;
+        case SIZE:
+        {
+            // A request for the size of this process's part of the hash
+            // table, led by the tag to reply with; the requesting client
+            // adds up the replies
+            int reply_tag = TOTAL_SIZE;
+            if (wire_unpack(buf, bytes, &rec) > 0 && rec.op == WIRE_REPLY_TAG)
+            {
+                reply_tag = (int)rec.value;
+            }
+            long localsize = (long)local_size();
+            server_reply(&localsize, 1, status->MPI_SOURCE, reply_tag, reply_comm);
+            break;
+        }
+        case SCAN:
+        {
+            // A key scan, led by the tag to reply with and followed by its
+            // bounds; the pairs stream back without the worker ever waiting
+            // for the client to take them
+            int reply_tag = RETURN_VALUE;
+            char bounds[3][MAX_KEYLEN];
+            struct local_scan scan = { NULL, NULL, NULL };
+            size_t offset = 0;
+            size_t used;
+            while ((used = wire_unpack(buf + offset, bytes - offset, &rec)) > 0)
+            {
+                if (rec.op == WIRE_REPLY_TAG)
+                {
+                    reply_tag = (int)rec.value;
+                }
+                else if (rec.op == WIRE_SCAN_LO)
+                {
+                    scan.lo = strcpy(bounds[0], rec.key);
+                }
+                else if (rec.op == WIRE_SCAN_HI)
+                {
+                    scan.hi = strcpy(bounds[1], rec.key);
+                }
+                else if (rec.op == WIRE_SCAN_PREFIX)
+                {
+                    scan.prefix = strcpy(bounds[2], rec.key);
+                }
+                offset += used;
+            }
+            send_scan(w, &scan, status->MPI_SOURCE, reply_tag);
+            break;
+        }
+        case DESTROY:
+
+            // Message DESTROY is received so the worker terminates
+            return false;
+        default:
+
+            break;
+
+    } // end switch case
+    return true;
+}
+
+// Counter for the messages served with each server tag (zero for tags that
+// are not counted)
+static const int served_metric[] =
+{
+    [PUT] = METRIC_SERVED_PUT,
+    [PUT_BATCH] = METRIC_SERVED_PUT,
+    [GET] = METRIC_SERVED_GET,
+    [GET_MANY] = METRIC_SERVED_GET_MANY,
+    [UPDATE] = METRIC_SERVED_UPDATE,
+    [SIZE] = METRIC_SERVED_SIZE,
+    [SCAN] = METRIC_SERVED_SCAN,
+    [INVALIDATE] = METRIC_SERVED_INVALIDATE,
+    [REPLICATE] = METRIC_SERVED_REPLICATE,
+    [BATCH_CONFIRM] = METRIC_SERVED_CONFIRM,
+    [INVALIDATE_ACK] = METRIC_SERVED_CONFIRM,
+};
+
+// Records one served message: its kind and size, how long the worker spent
+// on it, and how many more had arrived in the worker's receives by then
+static void count_served(struct worker *w, MPI_Status *status, unsigned long start)
+{
+    int bytes;
+    MPI_Get_count(status, MPI_BYTE, &bytes);
+    int waiting = 0;
+    for (int i = 1; i < RECVS_PER_WORKER; i++)
+    {
+        int ready;
+        MPI_Request_get_status(w->reqs[(w->next + i - 1) % RECVS_PER_WORKER], &ready, MPI_STATUS_IGNORE);
+        waiting += ready;
+    }
+    unsigned long elapsed = metrics_now_ns() - start;
+    int tag = status->MPI_TAG;
+    if (tag >= 0 && tag < (int)(sizeof(served_metric) / sizeof(int)) && served_metric[tag] != 0)
+    {
+        metrics_add(served_metric[tag], 1);
+    }
+    metrics_add(METRIC_SERVER_BYTES_RECEIVED, bytes);
+    metrics_add(METRIC_SERVICE_NS, elapsed);
+    metrics_max(METRIC_SERVICE_MAX_NS, elapsed);
+    metrics_add(METRIC_QUEUE_DEPTH, waiting);
+    metrics_max(METRIC_QUEUE_DEPTH_MAX, waiting);
+}
+
+// Serves the oldest request that has arrived for a worker, if there is one,
+// and reposts its receive. Returns false if nothing had arrived; *running is
+// cleared once the worker has been told to shut down.
+static bool serve_next(struct worker *w, bool *running)
+{
+    int done;
+    MPI_Status status;
+    if (w->send_count > 0)
+    {
+        reap_sends(w, false);
+    }
+    MPI_Test(&w->reqs[w->next], &done, &status);
+    if (!done)
+    {
+        return false;
+    }
+
+    unsigned long start = metrics_now_ns();
+    int slot = w->next;
+    w->next = (w->next + 1) % RECVS_PER_WORKER;
+    if (!handle_message(w, w->bufs[slot], &status))
+    {
+        *running = false;
+        return true;
+    }
+    count_served(w, &status, start);
+    MPI_Start(&w->reqs[slot]);
+    return true;
+}
+
+// Shuts a worker down once its last request has been served: waits for its
+// sends and withdraws the first posted of its receives (oldest first)
+static void stop_worker(struct worker *w, int posted)
+{
+    // Invalidations and replicas were all acknowledged at the final dht_sync,
+    // so these sends have completed
+    reap_sends(w, true);
+    free(w->sends);
+    free(w->send_bufs);
+
+    for (int i = 0; i < RECVS_PER_WORKER; i++)
+    {
+        int slot = (w->next + i) % RECVS_PER_WORKER;
+        if (i < posted)
+        {
+            MPI_Cancel(&w->reqs[slot]);
+            MPI_Wait(&w->reqs[slot], MPI_STATUS_IGNORE);
+        }
+        MPI_Request_free(&w->reqs[slot]);
+    }
+}
+
+/*
+Server worker thread. Requests land in pre-posted persistent receives; they are
+always handled oldest first and the receive is reposted right away, so a
+client's messages to this worker are processed in the order they were sent.
+*/
+void *server(void *ptr)
+{
+    struct worker *w = (struct worker *)ptr;
+    int idle = 0;
+    bool running = true;
+
+    MPI_Startall(RECVS_PER_WORKER, w->reqs);
+
+    // This loop will continue until it receives a message DESTROY
+    while (running)
+    {
+        if (serve_next(w, &running))
+        {
+            idle = 0;
+        }
+        else
+        {
+            backoff(&idle);
+        }
+    }
+
+    // Every request, invalidation and replica sent to this process was
+    // answered before the final dht_sync returned, so DESTROY is the last
+    // message a worker is sent and none of the receives still posted can
+    // have matched anything
+    stop_worker(w, RECVS_PER_WORKER - 1);
+    return NULL;
+}
+
+/*
+Progress engine (progress option). There are no server threads: the client
+thread calls this on entry to every DHT operation and over and over while it
+waits, and serves what has arrived for each of the workers. Two processes
+waiting on each other thus still answer each other's requests. Each call
+serves at most RECVS_PER_WORKER requests per worker, so a client that keeps
+sending (polling a key owned here, say) cannot keep this one from returning.
+*/
+static void progress()
+{
+    if (!options.progress)
+    {
+        return;
+    }
+    bool running = true;
+    for (int i = 0; i < options.server_threads; i++)
+    {
+        for (int served = 0; served < RECVS_PER_WORKER; served++)
+        {
+            if (!serve_next(&workers[i], &running))
+            {
+                break;  // nothing more has arrived for this worker
+            }
+        }
+    }
+}
+
+/**
+ * Process that placement gives a key. With the consistent-hash ring (the
+ * default) the key is looked up on the ring, and with range placement among
+ * the splitters (once they are chosen); otherwise its hash (by default the
+ * given hash function for this project, see ring_hash_djb2) is taken modulo
+ * nprocs.
+ */
+static int home(const char *name)
+{
+  if (options.placement == DHT_PLACEMENT_RING)
+  {
+    return ring_owner(&ring, name);
+  }
+  if (options.placement == DHT_PLACEMENT_RANGE && ranges_chosen)
+  {
+    return range_owner(&ranges, name);
+  }
+  return options.hash(name) % nprocs;
+}
+
+/**
+ * Owner of a key: where it has migrated to (see locality.h), or else its
+ * home
+ */
+int hash(const char *name)
+{
+  if (options.migrate_threshold > 0)
+  {
+    int owner = locality_owner(name);
+    if (owner >= 0)
+    {
+      return owner;
+    }
+  }
+  return home(name);
+}
+
+// Reads a numeric option from the environment, if it is set
+static long env_long(const char *name, long fallback)
+{
+    const char *text = getenv(name);
+    if (text == NULL || *text == '\0')
+    {
+        return fallback;
+    }
+    return strtol(text, NULL, 10);
+}
+
+// Identifies the key placement, so a snapshot is only restored where its
+// keys still belong
+static unsigned placement_id()
+{
+    unsigned id = options.hash == ring_hash_djb2 ? 1 :
+        options.hash == ring_hash_fnv1a ? 2 :
+        options.hash == ring_hash_murmur ? 3 : 0;
+    if (options.placement == DHT_PLACEMENT_RING)
+    {
+        id |= (unsigned)options.vnodes << 8;
+    }
+    return id << 1 | (unsigned)options.placement;
+}
+
+// Snapshot file of this process for a path prefix
+static void snapshot_path(char *path, size_t size, const char *prefix)
+{
+    snprintf(path, size, "%s-%03d.snap", prefix, rank);
+}
+
+// Saves this process's pairs as a snapshot and/or writes the collective dump
+// file if requested (collective); returns whether the text dump should be
+// skipped
+static bool save_outputs()
+{
+    bool saved = false;
+    if (options.snapshot != NULL && *options.snapshot != '\0')
+    {
+        char path[1024];
+        snapshot_path(path, sizeof(path), options.snapshot);
+        saved = local_save(path, rank, nprocs, placement_id());
+    }
+    if (options.dump_file != NULL && *options.dump_file != '\0')
+    {
+        size_t count;
+        struct snapshot_pair *pairs = local_pairs(&count);
+        if (dump_collective(MPI_COMM_WORLD, options.dump_file, options.dump_layout, pairs, count))
+        {
+            saved = true;
+        }
+        else if (rank == 0)
+        {
+            printf("ERROR: Could not write dump file \"%s\"\n", options.dump_file);
+        }
+        free(pairs);
+    }
+    return saved;
+}
+
+// Gathers every process's counters and writes the report, if one was
+// requested (collective; the servers must have stopped)
+static void write_stats()
+{
+    if (options.stats_file == NULL || *options.stats_file == '\0')
+    {
+        return;
+    }
+    unsigned long values[METRICS_COUNT];
+    metrics_get(values);
+    unsigned long *all = rank == 0 ? malloc(nprocs * sizeof(values)) : NULL;
+    MPI_Gather(values, METRICS_COUNT, MPI_UNSIGNED_LONG, all, METRICS_COUNT, MPI_UNSIGNED_LONG,
+            0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        if (!metrics_write(options.stats_file, all, nprocs))
+        {
+            printf("ERROR: Could not write stats file \"%s\"\n", options.stats_file);
+        }
+        free(all);
+    }
+}
+
+void dht_default_options(struct dht_options *opts)
+{
+    memset(opts, 0, sizeof(struct dht_options));
+    opts->async_put = env_long("DHT_ASYNC_PUT", 0) != 0;
+    opts->put_batch = (size_t)env_long("DHT_PUT_BATCH", 256);
+    opts->server_threads = (int)env_long("DHT_SERVER_THREADS", 1);
+    opts->progress = env_long("DHT_PROGRESS", 0) != 0;
+    opts->cache_size = (size_t)env_long("DHT_CACHE_SIZE", 0);
+    const char *mode = getenv("DHT_CACHE_INVALIDATE");
+    opts->cache_invalidation = mode != NULL && strcmp(mode, "push") == 0 ?
+        DHT_CACHE_PUSH : DHT_CACHE_EPOCH;
+    const char *placement = getenv("DHT_PLACEMENT");
+    opts->placement = DHT_PLACEMENT_RING;
+    if (placement != NULL && strcmp(placement, "modulo") == 0)
+    {
+        opts->placement = DHT_PLACEMENT_MODULO;
+    }
+    else if (placement != NULL && strcmp(placement, "range") == 0)
+    {
+        opts->placement = DHT_PLACEMENT_RANGE;
+    }
+    opts->vnodes = (int)env_long("DHT_VNODES", 64);
+    const char *hash_name = getenv("DHT_HASH");
+    opts->hash = hash_name != NULL ? ring_hash_by_name(hash_name) : NULL;
+    if (opts->hash == NULL)
+    {
+        opts->hash = ring_hash_djb2;
+    }
+    opts->range_sample = getenv("DHT_RANGE_SAMPLE");
+    const char *skew = getenv("DHT_REBALANCE_SKEW");
+    opts->rebalance_skew = skew != NULL && *skew != '\0' ? strtod(skew, NULL) : 1.5;
+    const char *backend = getenv("DHT_BACKEND");
+    opts->backend = backend != NULL && strcmp(backend, "rma") == 0 ?
+        DHT_BACKEND_RMA : DHT_BACKEND_MESSAGE;
+    opts->rma_slots = (size_t)env_long("DHT_RMA_SLOTS", 131072);
+    opts->shm = env_long("DHT_SHM", 0) != 0;
+    opts->snapshot = getenv("DHT_SNAPSHOT");
+    opts->restore = getenv("DHT_RESTORE");
+    opts->dump_file = getenv("DHT_DUMP_FILE");
+    const char *layout = getenv("DHT_DUMP_LAYOUT");
+    opts->dump_layout = layout != NULL && strcmp(layout, "binary") == 0 ?
+        DUMP_BINARY : DUMP_TEXT;
+    opts->hot_threshold = (int)env_long("DHT_HOT_THRESHOLD", 0);
+    opts->hot_replicas = (size_t)env_long("DHT_HOT_REPLICAS", 1024);
+    opts->migrate_threshold = (int)env_long("DHT_MIGRATE_THRESHOLD", 0);
+    opts->migrate_tracked = (size_t)env_long("DHT_MIGRATE_TRACKED", 65536);
+    opts->stats_file = getenv("DHT_STATS_FILE");
+    if (opts->stats_file == NULL)
+    {
+        opts->stats_file = "dht-stats.json";
+    }
+}
+
+int dht_init()
+{
+    struct dht_options opts;
+    dht_default_options(&opts);
+    return dht_init_opts(&opts);
+}
+
+// Chooses the range splitters from the keys of a file (collective; defined
+// with dht_bulk_load, which reads the same format)
+static bool sample_splitters(const char *path);
+
+int dht_init_opts(const struct dht_options *opts)
+{
+    int provided;
+
+    options = *opts;
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        // Every operation completes on the owner's memory directly, so
+        // there is nothing to batch and no server to push invalidations
+        options.async_put = false;
+        options.cache_size = 0;
+        options.hot_threshold = 0;
+        options.progress = false;
+    }
+    if (options.backend == DHT_BACKEND_RMA || options.placement == DHT_PLACEMENT_RANGE ||
+            (options.snapshot != NULL && *options.snapshot != '\0') || options.migrate_tracked == 0)
+    {
+        // Migrated keys would land in slots they cannot leave, outside
+        // their slice, or in a snapshot without the directory to find them
+        options.migrate_threshold = 0;
+    }
+    if (options.migrate_threshold < 0)
+    {
+        options.migrate_threshold = 0;
+    }
+    if (options.put_batch == 0)
+    {
+        options.put_batch = 1;
+    }
+    if (options.server_threads < 1)
+    {
+        options.server_threads = 1;
+    }
+    if (options.server_threads > LOCAL_SHARDS)
+    {
+        options.server_threads = LOCAL_SHARDS;
+    }
+
+    // The RMA backend and the progress engine have no server thread, so
+    // only this thread calls MPI
+    int required = options.backend == DHT_BACKEND_RMA || options.progress ?
+        MPI_THREAD_FUNNELED : MPI_THREAD_MULTIPLE;
+    MPI_Init_thread(NULL, NULL, required, &provided);
+    if (provided < required && provided >= MPI_THREAD_FUNNELED)
+    {
+        // An MPI without THREAD_MULTIPLE can still serve requests from the
+        // client thread
+        options.progress = true;
+        required = MPI_THREAD_FUNNELED;
+    }
+    if (provided < required)
+    {
+      printf("ERROR: Cannot initialize MPI in THREAD_FUNNELED mode.\n");
+      exit(EXIT_FAILURE);
+    }
+
+    // Set the rank and number of processes
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_dup(MPI_COMM_WORLD, &reply_comm);
+
+    // Every request reply tag is free
+    free_tags = malloc(REQUEST_TAGS * sizeof(int));
+    inflight = calloc(REQUEST_TAGS, sizeof(struct dht_request *));
+    for (int i = 0; i < REQUEST_TAGS; i++)
+    {
+        free_tags[i] = REQUEST_TAG_BASE + REQUEST_TAGS - 1 - i;
+    }
+    free_tag_count = REQUEST_TAGS;
+
+    // Per-owner put buffers and outstanding batch counts
+    put_batch_bytes = options.put_batch * WIRE_MAX_RECORD;
+    if (put_batch_bytes > WIRE_MAX_MESSAGE)
+    {
+        put_batch_bytes = WIRE_MAX_MESSAGE;
+    }
+    pending_batches = calloc(nprocs, sizeof(int));
+    put_buffers = calloc(nprocs * options.server_threads, sizeof(struct put_buffer));
+    for (int i = 0; i < nprocs * options.server_threads; i++)
+    {
+        put_buffers[i].req = MPI_REQUEST_NULL;
+    }
+
+    if (options.hash == NULL)
+    {
+        options.hash = ring_hash_djb2;
+    }
+    if (options.placement == DHT_PLACEMENT_RING)
+    {
+        ring_init(&ring, nprocs, options.vnodes, options.hash);
+    }
+    if (options.placement == DHT_PLACEMENT_RANGE)
+    {
+        range_init(&ranges, nprocs);
+        ranges_chosen = false;
+        if (options.range_sample != NULL && *options.range_sample != '\0' &&
+                !sample_splitters(options.range_sample) && rank == 0)
+        {
+            printf("ERROR: Could not read range sample \"%s\"\n", options.range_sample);
+        }
+    }
+
+    local_init();
+    metrics_init();
+    cache_init(options.cache_size);
+    if (options.hot_threshold < 0 || options.hot_replicas == 0)
+    {
+        options.hot_threshold = 0;
+    }
+    replica_init(options.hot_threshold > 0 ? options.hot_replicas : 0);
+    locality_init(options.migrate_threshold > 0 ? options.migrate_tracked : 0);
+    pending_invalidations = 0;
+
+    // Process ID is the process's rank
+    pid = rank;
+
+    if (options.restore != NULL && *options.restore != '\0')
+    {
+        if (options.backend == DHT_BACKEND_RMA)
+        {
+            printf("ERROR: the RMA backend cannot restore a snapshot.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (options.placement == DHT_PLACEMENT_RANGE)
+        {
+            printf("ERROR: range placement cannot restore a snapshot.\n");
+            exit(EXIT_FAILURE);
+        }
+        char path[1024];
+        snapshot_path(path, sizeof(path), options.restore);
+        local_load(path, rank, nprocs, placement_id());
+    }
+
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        rma_init(options.rma_slots, options.shm);
+        return pid;
+    }
+
+    // Set up the server workers' communicators and receives
+    workers = calloc(options.server_threads, sizeof(struct worker));
+    for (int i = 0; i < options.server_threads; i++)
+    {
+        struct worker *w = &workers[i];
+        w->id = i;
+        if (options.hot_threshold > 0)
+        {
+            sketch_init(&w->sketch, SKETCH_WIDTH, SKETCH_WINDOW);
+        }
+        MPI_Comm_dup(MPI_COMM_WORLD, &w->comm);
+        for (int r = 0; r < RECVS_PER_WORKER; r++)
+        {
+            w->bufs[r] = malloc(WIRE_MAX_MESSAGE);
+            MPI_Recv_init(w->bufs[r], WIRE_MAX_MESSAGE, MPI_BYTE, MPI_ANY_SOURCE, MPI_ANY_TAG, w->comm, &w->reqs[r]);
+        }
+    }
+
+    // Create server threads, or post the receives the progress engine polls
+    for (int i = 0; i < options.server_threads; i++)
+    {
+        if (options.progress)
+        {
+            MPI_Startall(RECVS_PER_WORKER, workers[i].reqs);
+        }
+        else
+        {
+            pthread_create(&workers[i].thread, NULL, server, &workers[i]);
+        }
+    }
+    return pid;
+}
+
+// Waits for count MPI requests, serving requests meanwhile in progress mode
+static void wait_all(int count, MPI_Request *reqs, MPI_Status *statuses)
+{
+    if (!options.progress)
+    {
+        MPI_Waitall(count, reqs, statuses);
+        return;
+    }
+    int done;
+    MPI_Testall(count, reqs, &done, statuses);
+    while (!done)
+    {
+        progress();
+        MPI_Testall(count, reqs, &done, statuses);
+    }
+}
+
+// Waits for any one of count MPI requests and sets *index to it, serving
+// requests meanwhile in progress mode
+static void wait_any(int count, MPI_Request *reqs, int *index)
+{
+    if (!options.progress)
+    {
+        MPI_Waitany(count, reqs, index, MPI_STATUS_IGNORE);
+        return;
+    }
+    int done;
+    MPI_Testany(count, reqs, index, &done, MPI_STATUS_IGNORE);
+    while (!done)
+    {
+        progress();
+        MPI_Testany(count, reqs, index, &done, MPI_STATUS_IGNORE);
+    }
+}
+
+// Waits for a server to change what approve_lock protects (the caller holds
+// it); in progress mode that server is this thread, so it serves requests
+// instead of sleeping
+static void wait_approval()
+{
+    if (!options.progress)
+    {
+        pthread_cond_wait(&approve_cond, &approve_lock);
+        return;
+    }
+    pthread_mutex_unlock(&approve_lock);
+    progress();
+    pthread_mutex_lock(&approve_lock);
+}
+
+// Waits for every process; in progress mode requests are served until the
+// last one arrives, since it may still be waiting for a reply from here
+static void barrier()
+{
+    if (!options.progress)
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+        return;
+    }
+    MPI_Request req;
+    MPI_Ibarrier(MPI_COMM_WORLD, &req);
+    wait_all(1, &req, MPI_STATUS_IGNORE);
+}
+
+// Prepares a request that is complete unless a message is sent for it
+static void init_request(struct dht_request *req)
+{
+    req->reqs[0] = MPI_REQUEST_NULL;
+    req->reqs[1] = MPI_REQUEST_NULL;
+    req->value_out = NULL;
+    req->cache = false;
+    req->tag = -1;
+    req->done = true;
+}
+
+// Returns a reply tag to the pool
+static void release_tag(int tag)
+{
+    pthread_mutex_lock(&request_lock);
+    inflight[tag - REQUEST_TAG_BASE] = NULL;
+    free_tags[free_tag_count++] = tag;
+    pthread_cond_signal(&tag_cond);
+    pthread_mutex_unlock(&request_lock);
+}
+
+// Delivers the reply of a request whose messages have completed and frees
+// its tag
+static void finish_request(struct dht_request *req)
+{
+    if (req->done)
+    {
+        return;
+    }
+    if (req->value_out != NULL)
+    {
+        *req->value_out = req->reply[0];
+        metrics_add(METRIC_CLIENT_BYTES_RECEIVED, (req->cache ? 2 : 1) * sizeof(long));
+
+        // Only values that exist are cached
+        if (req->cache && req->reply[0] != KEY_NOT_FOUND)
+        {
+            cache_insert(req->key, req->reply[0], (unsigned long)req->reply[1], req->stamp);
+        }
+    }
+    release_tag(req->tag);
+    req->tag = -1;
+    req->done = true;
+}
+
+// Waits for one request to complete
+static void wait_request(struct dht_request *req)
+{
+    if (!req->done)
+    {
+        unsigned long start = metrics_now_ns();
+        wait_all(2, req->reqs, MPI_STATUSES_IGNORE);
+        count_wait(METRIC_REPLY_WAIT_NS, start);
+        finish_request(req);
+    }
+}
+
+// Waits for every request in flight (their handles stay valid); no other
+// thread may be using the DHT meanwhile
+static void wait_inflight()
+{
+    struct dht_request **pending = malloc(REQUEST_TAGS * sizeof(struct dht_request *));
+    int count = 0;
+    pthread_mutex_lock(&request_lock);
+    for (int i = 0; i < REQUEST_TAGS; i++)
+    {
+        if (inflight[i] != NULL)
+        {
+            pending[count++] = inflight[i];
+        }
+    }
+    pthread_mutex_unlock(&request_lock);
+    for (int i = 0; i < count; i++)
+    {
+        wait_request(pending[i]);
+    }
+    free(pending);
+}
+
+// Takes a reply tag, held by req if it is not NULL. If every tag is held,
+// the calling thread completes one of its own requests in flight, or else
+// waits for another thread to release a tag.
+static int acquire_tag(struct dht_request *req)
+{
+    pthread_mutex_lock(&request_lock);
+    while (free_tag_count == 0)
+    {
+        struct dht_request **own = malloc(REQUEST_TAGS * sizeof(struct dht_request *));
+        MPI_Request *recvs = malloc(REQUEST_TAGS * sizeof(MPI_Request));
+        int count = 0;
+        for (int i = 0; i < REQUEST_TAGS; i++)
+        {
+            if (inflight[i] != NULL && pthread_equal(inflight[i]->owner, pthread_self()))
+            {
+                own[count] = inflight[i];
+                recvs[count++] = inflight[i]->reqs[0];
+            }
+        }
+        if (count == 0)
+        {
+            pthread_cond_wait(&tag_cond, &request_lock);
+        }
+        else
+        {
+            pthread_mutex_unlock(&request_lock);
+            int i;
+            wait_any(count, recvs, &i);
+            own[i]->reqs[0] = recvs[i];
+            wait_request(own[i]);
+            pthread_mutex_lock(&request_lock);
+        }
+        free(recvs);
+        free(own);
+    }
+    int tag = free_tags[--free_tag_count];
+    inflight[tag - REQUEST_TAG_BASE] = req;
+    if (req != NULL)
+    {
+        req->owner = pthread_self();
+    }
+    pthread_mutex_unlock(&request_lock);
+    return tag;
+}
+
+// Sends a put as a request with its own reply tag; the owner confirms it
+// with an empty message
+static void put_send(struct dht_request *req, int dest, const char *key, long value)
+{
+    req->tag = acquire_tag(req);
+    size_t bytes = wire_pack(req->msg, WIRE_REPLY_TAG, NULL, WIRE_HAS_VALUE, req->tag);
+    bytes += wire_pack(req->msg + bytes, WIRE_PUT, key, WIRE_HAS_VALUE, value);
+    MPI_Irecv(NULL, 0, MPI_BYTE, dest, req->tag, reply_comm, &req->reqs[0]);
+    MPI_Isend(req->msg, bytes, MPI_BYTE, dest, PUT, workers[worker_for(key)].comm, &req->reqs[1]);
+    count_send(bytes);
+}
+
+// Sends the puts buffered for one owner and worker as a single batch message.
+// The previous batch to the same place must have left its buffer first. The
+// caller holds put_lock.
+static void flush_puts_locked(int dest, int worker)
+{
+    struct put_buffer *buf = &put_buffers[dest * options.server_threads + worker];
+    if (buf->count == 0)
+    {
+        return;
+    }
+    wait_all(1, &buf->req, MPI_STATUS_IGNORE);
+
+    // Swap buffers so the next batch can fill while this one is sent
+    char *full = buf->data;
+    int bytes = (int)buf->used;
+    buf->data = buf->inflight;
+    buf->inflight = full;
+    buf->used = 0;
+    buf->count = 0;
+    if (buf->data == NULL)
+    {
+        buf->data = malloc(put_batch_bytes);
+    }
+
+    pthread_mutex_lock(&approve_lock);
+    pending_batches[dest]++;
+    pthread_mutex_unlock(&approve_lock);
+
+    MPI_Isend(full, bytes, MPI_BYTE, dest, PUT_BATCH, workers[worker].comm, &buf->req);
+    count_send(bytes);
+}
+
+static void flush_puts(int dest, int worker)
+{
+    pthread_mutex_lock(&put_lock);
+    flush_puts_locked(dest, worker);
+    pthread_mutex_unlock(&put_lock);
+}
+
+// Sends the puts buffered for every worker of one owner
+static void flush_owner_puts(int dest)
+{
+    for (int w = 0; w < options.server_threads; w++)
+    {
+        flush_puts(dest, w);
+    }
+}
+
+// Waits until every batch sent to dest has been applied by its owner
+// (dest < 0 waits for all owners)
+static void wait_batches(int dest)
+{
+    unsigned long start = 0;
+    pthread_mutex_lock(&approve_lock);
+    for (int i = 0; i < nprocs; i++)
+    {
+        if (dest >= 0 && i != dest)
+        {
+            continue;
+        }
+        while (pending_batches[i] > 0)
+        {
+            if (start == 0)
+            {
+                start = metrics_now_ns();
+            }
+            wait_approval();
+        }
+    }
+    pthread_mutex_unlock(&approve_lock);
+    if (start != 0)
+    {
+        count_wait(METRIC_CONFIRM_WAIT_NS, start);
+    }
+}
+
+// Sends everything still buffered and waits until all of it has been applied
+static void flush_all_puts()
+{
+    if (!options.async_put)
+    {
+        return;
+    }
+    for (int i = 0; i < nprocs; i++)
+    {
+        flush_owner_puts(i);
+    }
+    wait_batches(-1);
+    pthread_mutex_lock(&put_lock);
+    for (int i = 0; i < nprocs * options.server_threads; i++)
+    {
+        wait_all(1, &put_buffers[i].req, MPI_STATUS_IGNORE);
+    }
+    pthread_mutex_unlock(&put_lock);
+}
+
+// Starts a put; req completes once the owner has applied it
+static void start_put(struct dht_request *req, const char *key, long value)
+{
+    // Serve whatever other processes have asked of this one first (progress
+    // mode; likewise at the start of every other operation)
+    progress();
+
+    // Destination for the key and value
+    int dest = hash(key);
+    init_request(req);
+    metrics_add(METRIC_PUT, 1);
+
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        rma_put(dest, key, value);
+        return;
+    }
+
+    // Keys owned by this process never need to leave it
+    if (dest == rank)
+    {
+        char inval[WIRE_MAX_RECORD];
+        uint64_t sharers = 0;
+        size_t inval_bytes = apply_put(key, value, inval, &sharers);
+        send_invalidations(NULL, worker_for(key), inval, inval_bytes, sharers);
+        count_local(key);
+        return;
+    }
+
+    // A cached copy is out of date now, and a get still in flight must not
+    // bring it back
+    cache_remove(key);
+    replica_remove(key);
+
+    if (options.async_put)
+    {
+        // Buffer the put; it is sent once a full batch has accumulated (or
+        // at the next dht_sync)
+        int worker = worker_for(key);
+        struct put_buffer *buf = &put_buffers[dest * options.server_threads + worker];
+        pthread_mutex_lock(&put_lock);
+        if (buf->data == NULL)
+        {
+            buf->data = malloc(put_batch_bytes);
+        }
+        buf->used += wire_pack(buf->data + buf->used, WIRE_PUT, key, WIRE_HAS_VALUE, value);
+        buf->count++;
+        if (buf->count == options.put_batch || buf->used + WIRE_MAX_RECORD > put_batch_bytes)
+        {
+            flush_puts_locked(dest, worker);
+        }
+        pthread_mutex_unlock(&put_lock);
+        return;
+    }
+
+    // Send the key and value
+    req->done = false;
+    put_send(req, dest, key, value);
+}
+
+void dht_put(const char *key, long value)
+{
+    struct dht_request req;
+    start_put(&req, key, value);
+    wait_request(&req);
+}
+
+// Sends a get as a request with its own reply tag
+static void get_send(struct dht_request *req, int source, const char *key)
+{
+    // Put key into message; with the cache on, ask for the version as well
+    int flags = options.cache_size > 0 ? WIRE_WANT_VERSION : 0;
+    req->cache = flags != 0;
+    req->stamp = req->cache ? cache_stamp() : 0;
+    snprintf(req->key, MAX_KEYLEN, "%s", key);
+    req->tag = acquire_tag(req);
+    size_t bytes = wire_pack(req->msg, WIRE_REPLY_TAG, NULL, WIRE_HAS_VALUE, req->tag);
+    bytes += wire_pack(req->msg + bytes, WIRE_GET, key, flags, 0);
+
+    // Send a request for value
+    MPI_Irecv(req->reply, 2, MPI_LONG, source, req->tag, reply_comm, &req->reqs[0]);
+    MPI_Isend(req->msg, bytes, MPI_BYTE, source, GET, workers[worker_for(key)].comm, &req->reqs[1]);
+    count_send(bytes);
+}
+
+// Starts a get; *value_out is set when req completes
+static void start_get(struct dht_request *req, const char *key, long *value_out)
+{
+    progress();
+
+    // Source of the key
+    int source = hash(key);
+    init_request(req);
+    req->value_out = value_out;
+    metrics_add(METRIC_GET, 1);
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        *value_out = rma_get(source, key);
+        return;
+    }
+    if (source == rank)
+    {
+        *value_out = local_get(key);
+        count_local(key);
+        return;
+    }
+
+    if (options.hot_threshold > 0 && replica_lookup(key, value_out))
+    {
+        return;
+    }
+    if (options.cache_size > 0 && cache_lookup(key, value_out))
+    {
+        return;
+    }
+
+    // Buffered puts to the same owner must land before the get does
+    if (options.async_put)
+    {
+        flush_puts(source, worker_for(key));
+        wait_batches(source);
+    }
+
+    // Send the key
+    req->done = false;
+    get_send(req, source, key);
+}
+
+long dht_get(const char *key)
+{
+    long value;
+    struct dht_request req;
+    start_get(&req, key, &value);
+    wait_request(&req);
+
+    // Value at the key
+    return value;
+}
+
+struct dht_request *dht_iget(const char *key, long *value_out)
+{
+    struct dht_request *req = malloc(sizeof(struct dht_request));
+    start_get(req, key, value_out);
+    return req;
+}
+
+struct dht_request *dht_iput(const char *key, long value)
+{
+    struct dht_request *req = malloc(sizeof(struct dht_request));
+    start_put(req, key, value);
+    return req;
+}
+
+bool dht_test(struct dht_request **req)
+{
+    progress();
+    if (*req == NULL)
+    {
+        return true;
+    }
+    if (!(*req)->done)
+    {
+        int flag;
+        MPI_Testall(2, (*req)->reqs, &flag, MPI_STATUSES_IGNORE);
+        if (!flag)
+        {
+            return false;
+        }
+        finish_request(*req);
+    }
+    free(*req);
+    *req = NULL;
+    return true;
+}
+
+void dht_wait(struct dht_request **req)
+{
+    if (*req != NULL)
+    {
+        wait_request(*req);
+        free(*req);
+        *req = NULL;
+    }
+}
+
+void dht_waitall(struct dht_request **reqs, size_t n)
+{
+    // Wait for every MPI request at once, then finish them in order
+    MPI_Request *all = malloc((2 * n + 1) * sizeof(MPI_Request));
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (reqs[i] != NULL && !reqs[i]->done)
+        {
+            all[count++] = reqs[i]->reqs[0];
+            all[count++] = reqs[i]->reqs[1];
+        }
+    }
+    if (count > 0)
+    {
+        unsigned long start = metrics_now_ns();
+        wait_all((int)count, all, MPI_STATUSES_IGNORE);
+        count_wait(METRIC_REPLY_WAIT_NS, start);
+    }
+    count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (reqs[i] != NULL && !reqs[i]->done)
+        {
+            reqs[i]->reqs[0] = all[count++];
+            reqs[i]->reqs[1] = all[count++];
+            finish_request(reqs[i]);
+        }
+        free(reqs[i]);
+        reqs[i] = NULL;
+    }
+    free(all);
+}
+
+// One GET_MANY or UPDATE request: key slots [first, first+count) of the
+// grouped arrays, all owned by the same rank and worker
+struct get_chunk
+{
+    int dest;
+    int worker;
+    size_t first;
+    size_t count;
+};
+
+// Looks up n keys (deltas == NULL) or adds deltas[i] to each keys[i], with
+// one request per owner rank and worker (split to fit in a message), and
+// stores the values or new values in values_out in the caller's order
+static void request_many(const char **keys, const long *deltas, size_t n, long *values_out)
+{
+    progress();
+    int groups = nprocs * options.server_threads;
+
+    // Owner rank and worker of each key, as one group number
+    int *group = malloc((n + 1) * sizeof(int));
+    size_t *start = calloc(groups + 1, sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+    {
+        group[i] = hash(keys[i]) * options.server_threads + worker_for(keys[i]);
+        start[group[i] + 1]++;
+    }
+    for (int g = 0; g < groups; g++)
+    {
+        start[g + 1] += start[g];
+    }
+
+    // Order the keys by group (index[slot] is the caller's position)
+    size_t *index = malloc((n + 1) * sizeof(size_t));
+    size_t *fill = malloc(groups * sizeof(size_t));
+    memcpy(fill, start, groups * sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+    {
+        index[fill[group[i]]++] = i;
+    }
+
+    // Split each remote group into requests that fit in one message
+    size_t chunk_cap = 16;
+    size_t chunk_count = 0;
+    struct get_chunk *chunks = malloc(chunk_cap * sizeof(struct get_chunk));
+    for (int g = 0; g < groups; g++)
+    {
+        int dest = g / options.server_threads;
+        if (dest == rank)
+        {
+            continue;
+        }
+        size_t bytes = WIRE_MAX_MESSAGE;
+        for (size_t slot = start[g]; slot < start[g + 1]; slot++)
+        {
+            size_t need = WIRE_HEADER_BYTES + wire_key_length(keys[index[slot]]) +
+                (deltas != NULL ? sizeof(int64_t) : 0);
+            if (bytes + need > WIRE_MAX_MESSAGE)
+            {
+                if (chunk_count == chunk_cap)
+                {
+                    chunk_cap *= 2;
+                    chunks = realloc(chunks, chunk_cap * sizeof(struct get_chunk));
+                }
+                struct get_chunk *c = &chunks[chunk_count++];
+                c->dest = dest;
+                c->worker = g % options.server_threads;
+                c->first = slot;
+                c->count = 0;
+                bytes = WIRE_MAX_RECORD;    // room for the reply tag record
+            }
+            chunks[chunk_count - 1].count++;
+            bytes += need;
+        }
+    }
+
+    // Buffered puts to the owners involved must land first
+    if (options.async_put)
+    {
+        for (size_t c = 0; c < chunk_count; c++)
+        {
+            flush_puts(chunks[c].dest, chunks[c].worker);
+        }
+        wait_batches(-1);
+    }
+
+    // Answer the local keys
+    long *replies = malloc((n + 1) * sizeof(long));
+    for (int w = 0; w < options.server_threads; w++)
+    {
+        int g = rank * options.server_threads + w;
+        for (size_t slot = start[g]; slot < start[g + 1]; slot++)
+        {
+            const char *key = keys[index[slot]];
+            count_local(key);
+            if (deltas == NULL)
+            {
+                replies[slot] = local_get(key);
+                continue;
+            }
+            struct wire_record rec;
+            char inval[WIRE_MAX_RECORD];
+            rec.op = WIRE_ADD;
+            snprintf(rec.key, MAX_KEYLEN, "%s", key);
+            rec.value = deltas[index[slot]];
+            rec.expected = 0;
+            uint64_t sharers = 0;
+            size_t inval_bytes = apply_update(&rec, &replies[slot], inval, &sharers);
+            send_invalidations(NULL, w, inval, inval_bytes, sharers);
+        }
+    }
+
+    // Query the owners a window of requests at a time, every request in the
+    // window at once; each gets its own reply tag
+    char *requests = malloc((size_t)MAX_INFLIGHT * WIRE_MAX_MESSAGE);
+    MPI_Request reqs[2 * MAX_INFLIGHT];
+    int tags[MAX_INFLIGHT];
+    for (size_t base = 0; base < chunk_count; base += MAX_INFLIGHT)
+    {
+        int nreqs = 0;
+        for (size_t c = base; c < chunk_count && c < base + MAX_INFLIGHT; c++)
+        {
+            struct get_chunk *chunk = &chunks[c];
+            int tag = acquire_tag(NULL);
+            tags[c - base] = tag;
+            char *msg = requests + (c - base) * WIRE_MAX_MESSAGE;
+            size_t bytes = wire_pack(msg, WIRE_REPLY_TAG, NULL, WIRE_HAS_VALUE, tag);
+            for (size_t slot = chunk->first; slot < chunk->first + chunk->count; slot++)
+            {
+                const char *key = keys[index[slot]];
+                if (deltas == NULL)
+                {
+                    bytes += wire_pack(msg + bytes, WIRE_GET, key, 0, 0);
+                }
+                else
+                {
+                    cache_remove(key);
+                    replica_remove(key);
+                    bytes += wire_pack(msg + bytes, WIRE_ADD, key, WIRE_HAS_VALUE, deltas[index[slot]]);
+                }
+            }
+            MPI_Irecv(&replies[chunk->first], chunk->count, MPI_LONG, chunk->dest, tag, reply_comm, &reqs[nreqs++]);
+            MPI_Isend(msg, bytes, MPI_BYTE, chunk->dest, deltas == NULL ? GET_MANY : UPDATE,
+                    workers[chunk->worker].comm, &reqs[nreqs++]);
+            count_send(bytes);
+            metrics_add(METRIC_CLIENT_BYTES_RECEIVED, chunk->count * sizeof(long));
+        }
+        unsigned long start = metrics_now_ns();
+        wait_all(nreqs, reqs, MPI_STATUSES_IGNORE);
+        count_wait(METRIC_REPLY_WAIT_NS, start);
+        for (int t = 0; t < nreqs / 2; t++)
+        {
+            release_tag(tags[t]);
+        }
+    }
+
+    // Put each value back in the caller's order
+    for (size_t slot = 0; slot < n; slot++)
+    {
+        values_out[index[slot]] = replies[slot];
+    }
+
+    free(requests);
+    free(replies);
+    free(chunks);
+    free(fill);
+    free(index);
+    free(start);
+    free(group);
+}
+
+void dht_get_many(const char **keys, size_t n, long *values_out)
+{
+    metrics_add(METRIC_GET_MANY, n);
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            values_out[i] = rma_get(hash(keys[i]), keys[i]);
+        }
+        return;
+    }
+    request_many(keys, NULL, n, values_out);
+}
+
+// Applies one atomic update (LOCAL_ADD, LOCAL_CAS or LOCAL_MAX) at the key's
+// owner and returns its result
+static long update(int op, const char *key, long operand, long expected)
+{
+    progress();
+    int dest = hash(key);
+    metrics_add(METRIC_UPDATE, 1);
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        return rma_update(dest, op, key, operand, expected);
+    }
+
+    // Remote updates are led by the tag to reply with, so the record goes
+    // after room for it
+    char msg[2 * WIRE_MAX_RECORD];
+    char *rec_buf = msg + WIRE_MAX_RECORD;
+    int wire_op = op == LOCAL_ADD ? WIRE_ADD : op == LOCAL_CAS ? WIRE_CAS : WIRE_MAX;
+    size_t bytes = op == LOCAL_CAS ?
+        wire_pack_expected(rec_buf, wire_op, key, operand, expected) :
+        wire_pack(rec_buf, wire_op, key, WIRE_HAS_VALUE, operand);
+    long result;
+
+    // Keys owned by this process are updated in place
+    if (dest == rank)
+    {
+        struct wire_record rec;
+        char inval[WIRE_MAX_RECORD];
+        wire_unpack(rec_buf, bytes, &rec);
+        uint64_t sharers = 0;
+        size_t inval_bytes = apply_update(&rec, &result, inval, &sharers);
+        send_invalidations(NULL, worker_for(key), inval, inval_bytes, sharers);
+        count_local(key);
+        return result;
+    }
+
+    // A cached copy is out of date now, and buffered puts to the same owner
+    // must land first
+    cache_remove(key);
+    replica_remove(key);
+    if (options.async_put)
+    {
+        flush_puts(dest, worker_for(key));
+        wait_batches(dest);
+    }
+
+    int tag = acquire_tag(NULL);
+    size_t tag_bytes = wire_pack(msg, WIRE_REPLY_TAG, NULL, WIRE_HAS_VALUE, tag);
+    memmove(msg + tag_bytes, rec_buf, bytes);
+    MPI_Send(msg, tag_bytes + bytes, MPI_BYTE, dest, UPDATE, workers[worker_for(key)].comm);
+    count_send(tag_bytes + bytes);
+    unsigned long start = metrics_now_ns();
+    MPI_Request reply;
+    MPI_Irecv(&result, 1, MPI_LONG, dest, tag, reply_comm, &reply);
+    wait_all(1, &reply, MPI_STATUS_IGNORE);
+    count_wait(METRIC_REPLY_WAIT_NS, start);
+    metrics_add(METRIC_CLIENT_BYTES_RECEIVED, sizeof(long));
+    release_tag(tag);
+    return result;
+}
+
+long dht_add(const char *key, long delta)
+{
+    return update(LOCAL_ADD, key, delta, 0);
+}
+
+long dht_compare_and_swap(const char *key, long expected, long desired)
+{
+    return update(LOCAL_CAS, key, desired, expected);
+}
+
+long dht_fetch_max(const char *key, long value)
+{
+    return update(LOCAL_MAX, key, value, 0);
+}
+
+void dht_add_many(const char **keys, const long *deltas, size_t n, long *new_values_out)
+{
+    long *values = new_values_out != NULL ? new_values_out : malloc((n + 1) * sizeof(long));
+    metrics_add(METRIC_UPDATE, n);
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            values[i] = rma_update(hash(keys[i]), LOCAL_ADD, keys[i], deltas[i], 0);
+        }
+    }
+    else
+    {
+        request_many(keys, deltas, n, values);
+    }
+    if (values != new_values_out)
+    {
+        free(values);
+    }
+}
+
+// One owner's part of a scan being merged: pairs already at hand (scanned
+// locally or through RMA), or chunks of WIRE_PUT records from the owner's
+// server, the next of which is received while the current one is read
+struct scan_stream
+{
+    bool remote;
+    struct snapshot_pair *pairs;    // pairs at hand
+    size_t count;
+    size_t next_pair;
+    int source;                     // owner streaming the chunks
+    char *chunk;                    // chunk being read
+    int bytes;
+    size_t pos;
+    char *incoming;                 // chunk being received
+    MPI_Request req;
+    bool done;
+    struct wire_record head;        // pair at the front of the stream
+};
+
+// Moves a stream on to its next pair, or marks it done
+static void scan_advance(struct scan_stream *s, int tag)
+{
+    if (!s->remote)
+    {
+        if (s->next_pair == s->count)
+        {
+            s->done = true;
+            return;
+        }
+        snprintf(s->head.key, MAX_KEYLEN, "%s", s->pairs[s->next_pair].key);
+        s->head.value = (long)s->pairs[s->next_pair++].value;
+        return;
+    }
+
+    size_t used;
+    while ((used = wire_unpack(s->chunk + s->pos, s->bytes - s->pos, &s->head)) == 0)
+    {
+        // The current chunk is used up; take the next one and start
+        // receiving the one after it (an empty chunk ends the stream)
+        MPI_Status status;
+        unsigned long start = metrics_now_ns();
+        wait_all(1, &s->req, &status);
+        count_wait(METRIC_REPLY_WAIT_NS, start);
+        MPI_Get_count(&status, MPI_BYTE, &s->bytes);
+        metrics_add(METRIC_CLIENT_BYTES_RECEIVED, s->bytes);
+        if (s->bytes == 0)
+        {
+            s->done = true;
+            return;
+        }
+        char *read = s->incoming;
+        s->incoming = s->chunk;
+        s->chunk = read;
+        s->pos = 0;
+        MPI_Irecv(s->incoming, WIRE_MAX_MESSAGE, MPI_BYTE, s->source, tag, reply_comm, &s->req);
+    }
+    s->pos += used;
+}
+
+// Restores the order of a binary heap of streams (by the key at the front
+// of each) from position i down
+static void scan_sift(struct scan_stream *streams, int *heap, int n, int i)
+{
+    while (1)
+    {
+        int least = i;
+        for (int child = 2 * i + 1; child <= 2 * i + 2 && child < n; child++)
+        {
+            if (strncmp(streams[heap[child]].head.key, streams[heap[least]].head.key, MAX_KEYLEN) < 0)
+            {
+                least = child;
+            }
+        }
+        if (least == i)
+        {
+            return;
+        }
+        int swap = heap[i];
+        heap[i] = heap[least];
+        heap[least] = swap;
+        i = least;
+    }
+}
+
+// Runs a scan on every owner at once and merges the streams of pairs they
+// send back, in key order, into the callback
+static size_t scan(const struct local_scan *range, dht_scan_fn callback, void *arg)
+{
+    progress();
+    struct scan_stream *streams = calloc(nprocs, sizeof(struct scan_stream));
+    int tag = -1;
+
+    // With range placement only the owners of slices the scan overlaps can
+    // have matching keys; the other streams stay empty
+    int first = 0;
+    int last = nprocs - 1;
+    if (options.placement == DHT_PLACEMENT_RANGE && ranges_chosen)
+    {
+        range_owners(&ranges, range, &first, &last);
+    }
+
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        for (int i = first; i <= last; i++)
+        {
+            streams[i].pairs = rma_scan(i, range, &streams[i].count);
+        }
+    }
+    else
+    {
+        // This process's own puts must be seen
+        flush_all_puts();
+
+        char msg[4 * WIRE_MAX_RECORD];
+        tag = acquire_tag(NULL);
+        size_t bytes = wire_pack(msg, WIRE_REPLY_TAG, NULL, WIRE_HAS_VALUE, tag);
+        if (range->lo != NULL)
+        {
+            bytes += wire_pack(msg + bytes, WIRE_SCAN_LO, range->lo, 0, 0);
+        }
+        if (range->hi != NULL)
+        {
+            bytes += wire_pack(msg + bytes, WIRE_SCAN_HI, range->hi, 0, 0);
+        }
+        if (range->prefix != NULL)
+        {
+            bytes += wire_pack(msg + bytes, WIRE_SCAN_PREFIX, range->prefix, 0, 0);
+        }
+        for (int i = first; i <= last; i++)
+        {
+            if (i == rank)
+            {
+                continue;
+            }
+            struct scan_stream *s = &streams[i];
+            s->remote = true;
+            s->source = i;
+            s->chunk = malloc(WIRE_MAX_MESSAGE);
+            s->incoming = malloc(WIRE_MAX_MESSAGE);
+            MPI_Irecv(s->incoming, WIRE_MAX_MESSAGE, MPI_BYTE, i, tag, reply_comm, &s->req);
+            MPI_Send(msg, bytes, MPI_BYTE, i, SCAN, workers[0].comm);
+            count_send(bytes);
+        }
+        if (rank >= first && rank <= last)
+        {
+            streams[rank].pairs = local_scan(range, &streams[rank].count);
+        }
+    }
+
+    // Merge the streams, smallest front key first
+    int *heap = malloc(nprocs * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        scan_advance(&streams[i], tag);
+        if (!streams[i].done)
+        {
+            heap[n++] = i;
+        }
+    }
+    for (int i = n / 2 - 1; i >= 0; i--)
+    {
+        scan_sift(streams, heap, n, i);
+    }
+    size_t delivered = 0;
+    while (n > 0)
+    {
+        struct scan_stream *s = &streams[heap[0]];
+        callback(s->head.key, s->head.value, arg);
+        delivered++;
+        scan_advance(s, tag);
+        if (s->done)
+        {
+            heap[0] = heap[--n];
+        }
+        scan_sift(streams, heap, n, 0);
+    }
+
+    for (int i = 0; i < nprocs; i++)
+    {
+        free(streams[i].pairs);
+        free(streams[i].chunk);
+        free(streams[i].incoming);
+    }
+    free(streams);
+    free(heap);
+    if (tag >= 0)
+    {
+        release_tag(tag);
+    }
+    metrics_add(METRIC_SCAN, delivered);
+    return delivered;
+}
+
+size_t dht_scan_range(const char *lo, const char *hi, dht_scan_fn callback, void *arg)
+{
+    struct local_scan range = { lo, hi, NULL };
+    return scan(&range, callback, arg);
+}
+
+size_t dht_scan_prefix(const char *prefix, dht_scan_fn callback, void *arg)
+{
+    // Every key with the prefix sorts at or after it
+    struct local_scan range = { prefix, NULL, prefix };
+    return scan(&range, callback, arg);
+}
+
+// Next space-separated word of a line in [*pos, end); returns its length
+static size_t next_word(const char *text, size_t *pos, size_t end, const char **word)
+{
+    while (*pos < end && (text[*pos] == ' ' || text[*pos] == '\t' || text[*pos] == '\r'))
+    {
+        (*pos)++;
+    }
+    *word = text + *pos;
+    while (*pos < end && text[*pos] != ' ' && text[*pos] != '\t' && text[*pos] != '\r')
+    {
+        (*pos)++;
+    }
+    return (size_t)(text + *pos - *word);
+}
+
+// Reads one "key value" or "put key value" line [pos, end) of a bulk load
+// file
+static bool parse_pair(const char *text, size_t pos, size_t end, char *key, long *value)
+{
+    const char *words[3];
+    size_t lens[3];
+    int n = 0;
+    if (pos < end && text[pos] == '#')
+    {
+        return false;
+    }
+    while (n < 3 && (lens[n] = next_word(text, &pos, end, &words[n])) > 0)
+    {
+        n++;
+    }
+    int first = n == 3 && lens[0] == 3 && memcmp(words[0], "put", 3) == 0 ? 1 : 0;
+    if (n != first + 2)
+    {
+        return false;
+    }
+
+    char number[32];
+    size_t len = lens[first + 1] < sizeof(number) ? lens[first + 1] : sizeof(number) - 1;
+    memcpy(number, words[first + 1], len);
+    number[len] = '\0';
+    char *stop;
+    *value = strtol(number, &stop, 10);
+    if (*stop != '\0')
+    {
+        return false;
+    }
+    len = lens[first] < MAX_KEYLEN ? lens[first] : MAX_KEYLEN - 1;
+    memcpy(key, words[first], len);
+    key[len] = '\0';
+    return true;
+}
+
+// Maps a file of lines on every process and finds the lines [*lo, *hi) that
+// start in this process's slice of it (collective). Returns false, with
+// nothing mapped, if a process cannot read the file.
+static bool map_slice(const char *path, char **text_out, size_t *size_out, size_t *lo_out, size_t *hi_out)
+{
+    char *text = NULL;
+    size_t size = 0;
+    int ok = 1;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        ok = 0;
+    }
+    else if (st.st_size > 0)
+    {
+        size = (size_t)st.st_size;
+        text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED)
+        {
+            text = NULL;
+            ok = 0;
+        }
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!all_ok)
+    {
+        if (text != NULL)
+        {
+            munmap(text, size);
+        }
+        return false;
+    }
+
+    // This process reads the lines that start in its slice of the file
+    size_t lo = size / nprocs * rank + (size % nprocs) * rank / nprocs;
+    size_t hi = size / nprocs * (rank + 1) + (size % nprocs) * (rank + 1) / nprocs;
+    if (lo > 0 && text[lo - 1] != '\n')
+    {
+        const char *nl = memchr(text + lo, '\n', size - lo);
+        lo = nl == NULL ? size : (size_t)(nl - text) + 1;
+    }
+    *text_out = text;
+    *size_out = size;
+    *lo_out = lo;
+    *hi_out = hi;
+    return true;
+}
+
+// Chooses the range splitters for the first bulk load (collective; defined
+// with dht_rebalance, which moves pairs into their slices the same way)
+static bool choose_load_slices(const char *path);
+
+long dht_bulk_load(const char *path)
+{
+    // Everything issued before the load lands first
+    wait_inflight();
+    flush_all_puts();
+    if (options.progress)
+    {
+        // and every process has its replies before any stops serving for
+        // the collectives below
+        barrier();
+    }
+
+    if (options.placement == DHT_PLACEMENT_RANGE && !ranges_chosen &&
+            !choose_load_slices(path))
+    {
+        return -1;
+    }
+
+    char *text;
+    size_t size, lo, hi;
+    if (!map_slice(path, &text, &size, &lo, &hi))
+    {
+        return -1;
+    }
+
+    // Bucket the pairs by owner as packed put records
+    char **bufs = calloc(nprocs, sizeof(char *));
+    size_t *used = calloc(nprocs, sizeof(size_t));
+    size_t *cap = calloc(nprocs, sizeof(size_t));
+    size_t pos = lo;
+    while (pos < hi)
+    {
+        const char *nl = memchr(text + pos, '\n', size - pos);
+        size_t end = nl == NULL ? size : (size_t)(nl - text);
+        char key[MAX_KEYLEN];
+        long value;
+        if (parse_pair(text, pos, end, key, &value))
+        {
+            int dest = hash(key);
+            if (used[dest] + WIRE_MAX_RECORD > cap[dest])
+            {
+                cap[dest] = cap[dest] == 0 ? 64 * 1024 : cap[dest] * 2;
+                bufs[dest] = realloc(bufs[dest], cap[dest]);
+            }
+            used[dest] += wire_pack(bufs[dest] + used[dest], WIRE_PUT, key, WIRE_HAS_VALUE, value);
+        }
+        pos = end + 1;
+    }
+    if (text != NULL)
+    {
+        munmap(text, size);
+    }
+
+    // One all-to-all exchange sends every pair to its owner
+    int *send_counts = malloc(nprocs * sizeof(int));
+    int *recv_counts = malloc(nprocs * sizeof(int));
+    int *send_displs = malloc(nprocs * sizeof(int));
+    int *recv_displs = malloc(nprocs * sizeof(int));
+    size_t send_total = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        send_counts[i] = (int)used[i];
+        send_displs[i] = (int)send_total;
+        send_total += used[i];
+    }
+    if (send_total > INT_MAX)
+    {
+        fprintf(stderr, "ERROR: process %d's slice of \"%s\" is too large to load\n", rank, path);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    char *send_buf = malloc(send_total + 1);
+    for (int i = 0; i < nprocs; i++)
+    {
+        if (used[i] > 0)
+        {
+            memcpy(send_buf + send_displs[i], bufs[i], used[i]);
+        }
+        free(bufs[i]);
+    }
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
+    size_t recv_total = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        recv_displs[i] = (int)recv_total;
+        recv_total += (size_t)recv_counts[i];
+    }
+    if (recv_total > INT_MAX)
+    {
+        fprintf(stderr, "ERROR: process %d's part of \"%s\" is too large to load\n", rank, path);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    char *recv_buf = malloc(recv_total + 1);
+    MPI_Alltoallv(send_buf, send_counts, send_displs, MPI_BYTE,
+            recv_buf, recv_counts, recv_displs, MPI_BYTE, MPI_COMM_WORLD);
+    free(send_buf);
+
+    // Build this process's part of the table directly; pairs arrive in file
+    // order, so the last of several puts of a key wins
+    size_t count = 0;
+    struct snapshot_pair *pairs = malloc((recv_total / WIRE_HEADER_BYTES + 1) * sizeof(struct snapshot_pair));
+    struct wire_record rec;
+    size_t offset = 0;
+    size_t rec_bytes;
+    while ((rec_bytes = wire_unpack(recv_buf + offset, recv_total - offset, &rec)) > 0)
+    {
+        memcpy(pairs[count].key, rec.key, MAX_KEYLEN);
+        pairs[count].value = rec.value;
+        count++;
+        offset += rec_bytes;
+    }
+    free(recv_buf);
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            rma_put(rank, pairs[i].key, (long)pairs[i].value);
+        }
+    }
+    else
+    {
+        local_put_bulk(pairs, count);
+    }
+    free(pairs);
+
+    // Cached and replicated values may have been replaced without an
+    // invalidation
+    cache_clear();
+    replica_clear();
+
+    // Once every process has built its part, the whole load is visible
+    metrics_add(METRIC_BULK_LOAD, count);
+    long loaded = (long)count;
+    long total;
+    MPI_Allreduce(&loaded, &total, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    free(send_counts);
+    free(recv_counts);
+    free(send_displs);
+    free(recv_displs);
+    free(cap);
+    free(used);
+    free(bufs);
+    return total;
+}
+
+// Chooses the range splitters from every process's keys, sorted and each at
+// the start of a pitch-byte element (collective). This is the splitter step
+// of a parallel sample sort: every process takes evenly spaced keys at the
+// same global stride, so each contributes in proportion to the keys it
+// holds, and all pick the same quantiles of the gathered sample.
+static void choose_splitters(const char *keys, size_t count, size_t pitch)
+{
+    unsigned long local = count;
+    unsigned long total;
+    MPI_Allreduce(&local, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    size_t stride = total / ((size_t)RANGE_OVERSAMPLE * nprocs);
+    if (stride == 0)
+    {
+        stride = 1;
+    }
+
+    // This process's share of the sample: every stride-th key, starting in
+    // the middle of the first stride
+    int taken = count > stride / 2 ? (int)((count - stride / 2 - 1) / stride + 1) : 0;
+    char *sample = malloc((size_t)taken * MAX_KEYLEN + 1);
+    for (int i = 0; i < taken; i++)
+    {
+        snprintf(sample + (size_t)i * MAX_KEYLEN, MAX_KEYLEN, "%s",
+                keys + (stride / 2 + (size_t)i * stride) * pitch);
+    }
+
+    // Every process gathers the whole sample and splits it the same way
+    int bytes = taken * MAX_KEYLEN;
+    int *counts = malloc(nprocs * sizeof(int));
+    int *displs = malloc(nprocs * sizeof(int));
+    MPI_Allgather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+    size_t all_bytes = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        displs[i] = (int)all_bytes;
+        all_bytes += (size_t)counts[i];
+    }
+    char *all = malloc(all_bytes + 1);
+    MPI_Allgatherv(sample, bytes, MPI_BYTE, all, counts, displs, MPI_BYTE, MPI_COMM_WORLD);
+    range_split(&ranges, all, all_bytes / MAX_KEYLEN, MAX_KEYLEN);
+    ranges_chosen = ranges_chosen || all_bytes > 0;
+
+    free(all);
+    free(displs);
+    free(counts);
+    free(sample);
+}
+
+static bool sample_splitters(const char *path)
+{
+    char *text;
+    size_t size, lo, hi;
+    if (!map_slice(path, &text, &size, &lo, &hi))
+    {
+        return false;
+    }
+
+    // The keys of this process's slice, sorted
+    char (*keys)[MAX_KEYLEN] = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    size_t pos = lo;
+    while (pos < hi)
+    {
+        const char *nl = memchr(text + pos, '\n', size - pos);
+        size_t end = nl == NULL ? size : (size_t)(nl - text);
+        long value;
+        if (count == cap)
+        {
+            cap = cap == 0 ? 1024 : cap * 2;
+            keys = realloc(keys, cap * MAX_KEYLEN);
+        }
+        if (parse_pair(text, pos, end, keys[count], &value))
+        {
+            count++;
+        }
+        pos = end + 1;
+    }
+    if (text != NULL)
+    {
+        munmap(text, size);
+    }
+    range_sort((char *)keys, count, MAX_KEYLEN);
+
+    choose_splitters((char *)keys, count, MAX_KEYLEN);
+    free(keys);
+    return true;
+}
+
+// Moves every pair (count of them, sorted, as local_pairs returns them) to
+// the owner of its slice and frees pairs (collective). Returns the number of
+// pairs that changed owner on any process.
+static long move_to_slices(struct snapshot_pair *pairs, size_t count)
+{
+    // The pairs are sorted and every slice is contiguous, so each new
+    // owner's pairs are already together; one all-to-all exchange moves
+    // them (this process's own included)
+    int *send_counts = calloc(nprocs, sizeof(int));
+    int *recv_counts = malloc(nprocs * sizeof(int));
+    int *send_displs = malloc(nprocs * sizeof(int));
+    int *recv_displs = malloc(nprocs * sizeof(int));
+    long moved = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int owner = range_owner(&ranges, pairs[i].key);
+        send_counts[owner]++;
+        moved += owner != rank;
+    }
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
+    size_t send_total = 0;
+    size_t recv_total = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        send_displs[i] = (int)send_total;
+        send_total += (size_t)send_counts[i];
+        recv_displs[i] = (int)recv_total;
+        recv_total += (size_t)recv_counts[i];
+    }
+    MPI_Datatype pair_type;
+    MPI_Type_contiguous(sizeof(struct snapshot_pair), MPI_BYTE, &pair_type);
+    MPI_Type_commit(&pair_type);
+    struct snapshot_pair *kept = malloc((recv_total + 1) * sizeof(struct snapshot_pair));
+    MPI_Alltoallv(pairs, send_counts, send_displs, pair_type,
+            kept, recv_counts, recv_displs, pair_type, MPI_COMM_WORLD);
+    MPI_Type_free(&pair_type);
+    free(pairs);
+
+    // Rebuild this process's part of the table from its new slice
+    local_init();
+    local_put_bulk(kept, recv_total);
+    free(kept);
+
+    // Cached and replicated values may now live elsewhere
+    cache_clear();
+    replica_clear();
+
+    // Once every process has rebuilt its part, the new placement is in use
+    long all_moved;
+    MPI_Allreduce(&moved, &all_moved, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    free(send_counts);
+    free(recv_counts);
+    free(send_displs);
+    free(recv_displs);
+    return all_moved;
+}
+
+// Range placement without splitters yet: chooses them from the keys of the
+// file about to be loaded, and moves the pairs placed by hash so far into
+// their slices (collective). With the RMA backend, pairs cannot move, so the
+// splitters are only chosen while the table is empty. Returns false if a
+// process cannot read the file.
+static bool choose_load_slices(const char *path)
+{
+    // Placement is about to change: every invalidation and replica must be
+    // applied first, so none arrives for a key that has moved
+    dht_sync();
+
+    unsigned long size = options.backend == DHT_BACKEND_RMA ? rma_count(rank) : local_size();
+    unsigned long total;
+    MPI_Allreduce(&size, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (options.backend == DHT_BACKEND_RMA && total > 0)
+    {
+        return true;
+    }
+    if (!sample_splitters(path))
+    {
+        return false;
+    }
+    if (total > 0 && ranges_chosen)
+    {
+        size_t count;
+        struct snapshot_pair *pairs = local_pairs(&count);
+        move_to_slices(pairs, count);
+    }
+    return true;
+}
+
+long dht_rebalance()
+{
+    if (options.placement != DHT_PLACEMENT_RANGE || options.backend == DHT_BACKEND_RMA)
+    {
+        return -1;
+    }
+
+    // Everything issued before the call is in place, and moves with it
+    dht_sync();
+
+    // Leave the splitters alone unless the largest shard has drifted too
+    // far from the mean; keys still placed by hash always move into slices
+    unsigned long size = local_size();
+    unsigned long total;
+    unsigned long largest;
+    MPI_Allreduce(&size, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&size, &largest, 1, MPI_UNSIGNED_LONG, MPI_MAX, MPI_COMM_WORLD);
+    if (total == 0 || (ranges_chosen && largest <= options.rebalance_skew * total / nprocs))
+    {
+        return 0;
+    }
+
+    // New splitters from a sample of the keys where they are now
+    size_t count;
+    struct snapshot_pair *pairs = local_pairs(&count);
+    choose_splitters((const char *)pairs, count, sizeof(struct snapshot_pair));
+    return move_to_slices(pairs, count);
+}
+
+void dht_cache_stats(struct cache_stats *stats)
+{
+    cache_get_stats(stats);
+}
+
+void dht_replica_stats(struct replica_stats *stats)
+{
+    replica_get_stats(stats);
+}
+
+size_t dht_size()
+{
+    progress();
+    long size = 0;
+    metrics_add(METRIC_SIZE, 1);
+
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        size_t total = 0;
+        for (int i = 0; i < nprocs; i++)
+        {
+            total += rma_count(i);
+        }
+        return total;
+    }
+
+    // This process's own puts must be counted
+    flush_all_puts();
+
+    // All other processes get requested for their size
+    char msg[WIRE_MAX_RECORD];
+    int tag = acquire_tag(NULL);
+    size_t bytes = wire_pack(msg, WIRE_REPLY_TAG, NULL, WIRE_HAS_VALUE, tag);
+    for (int i = 0; i < nprocs; i++)
+    {
+        if (i != rank)
+        {
+            MPI_Send(msg, bytes, MPI_BYTE, i, SIZE, workers[0].comm);
+            count_send(bytes);
+        }
+    }
+
+    // Receive and add up each part
+    size = (long)local_size();
+    unsigned long start = metrics_now_ns();
+    long *parts = malloc(nprocs * sizeof(long));
+    MPI_Request *reqs = malloc(nprocs * sizeof(MPI_Request));
+    for (int i = 0; i < nprocs - 1; i++)
+    {
+        MPI_Irecv(&parts[i], 1, MPI_LONG, MPI_ANY_SOURCE, tag, reply_comm, &reqs[i]);
+    }
+    wait_all(nprocs - 1, reqs, MPI_STATUSES_IGNORE);
+    for (int i = 0; i < nprocs - 1; i++)
+    {
+        size += parts[i];
+    }
+    free(reqs);
+    free(parts);
+    count_wait(METRIC_REPLY_WAIT_NS, start);
+    metrics_add(METRIC_CLIENT_BYTES_RECEIVED, (nprocs - 1) * sizeof(long));
+    release_tag(tag);
+    return size;
+}
+
+// Moves every key whose dominant accessor is another process there, and
+// brings every process's directory up to date (collective; everything
+// issued before must have been applied)
+static void migrate_keys()
+{
+    size_t count;
+    struct locality_move *moves = locality_moves(rank, (unsigned)options.migrate_threshold, &count);
+
+    // Take the keys still here out of the table, grouped by new owner
+    int *send_counts = calloc(nprocs, sizeof(int));
+    int *recv_counts = malloc(nprocs * sizeof(int));
+    int *send_displs = malloc(nprocs * sizeof(int));
+    int *recv_displs = malloc(nprocs * sizeof(int));
+    for (size_t i = 0; i < count; i++)
+    {
+        send_counts[moves[i].owner]++;
+    }
+    int sent = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        send_displs[i] = sent;
+        sent += send_counts[i];
+        send_counts[i] = 0;
+    }
+    struct snapshot_pair *pairs = malloc((count + 1) * sizeof(struct snapshot_pair));
+    struct locality_move *taken = malloc((count + 1) * sizeof(struct locality_move));
+    for (size_t i = 0; i < count; i++)
+    {
+        int owner = moves[i].owner;
+        long value;
+        if (local_take(moves[i].key, &value))
+        {
+            int slot = send_displs[owner] + send_counts[owner]++;
+            memcpy(pairs[slot].key, moves[i].key, MAX_KEYLEN);
+            pairs[slot].value = value;
+        }
+    }
+
+    // One all-to-all exchange hands every pair to its new owner
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
+    int received = 0;
+    sent = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        recv_displs[i] = received;
+        received += recv_counts[i];
+        for (int j = 0; j < send_counts[i]; j++)
+        {
+            memcpy(taken[sent].key, pairs[send_displs[i] + j].key, MAX_KEYLEN);
+            taken[sent++].owner = i;
+        }
+    }
+    MPI_Datatype pair_type;
+    MPI_Type_contiguous(sizeof(struct snapshot_pair), MPI_BYTE, &pair_type);
+    MPI_Type_commit(&pair_type);
+    struct snapshot_pair *arrived = malloc((received + 1) * sizeof(struct snapshot_pair));
+    MPI_Alltoallv(pairs, send_counts, send_displs, pair_type,
+            arrived, recv_counts, recv_displs, pair_type, MPI_COMM_WORLD);
+    MPI_Type_free(&pair_type);
+    local_put_bulk(arrived, received);
+    metrics_add(METRIC_MIGRATED_OUT, sent);
+    metrics_add(METRIC_MIGRATED_IN, received);
+
+    // Every process learns every move, once all new owners hold their keys
+    MPI_Datatype move_type;
+    MPI_Type_contiguous(sizeof(struct locality_move), MPI_BYTE, &move_type);
+    MPI_Type_commit(&move_type);
+    MPI_Allgather(&sent, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
+    int total = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+        recv_displs[i] = total;
+        total += recv_counts[i];
+    }
+    struct locality_move *all = malloc((total + 1) * sizeof(struct locality_move));
+    MPI_Allgatherv(taken, sent, move_type, all, recv_counts, recv_displs, move_type, MPI_COMM_WORLD);
+    MPI_Type_free(&move_type);
+    for (int i = 0; i < total; i++)
+    {
+        locality_set_owner(all[i].key, all[i].owner == home(all[i].key) ? -1 : all[i].owner);
+    }
+    if (total > 0)
+    {
+        // Cached and replicated values are no longer tracked by their owners
+        cache_clear();
+        replica_clear();
+    }
+
+    free(all);
+    free(arrived);
+    free(taken);
+    free(pairs);
+    free(send_counts);
+    free(recv_counts);
+    free(send_displs);
+    free(recv_displs);
+    free(moves);
+}
+
+// Makes every request issued so far visible and waits for every process
+// (collective)
+static void sync_all()
+{
+    // All outstanding requests and buffered puts must be visible once every
+    // client is past the barrier
+    metrics_add(METRIC_SYNC, 1);
+    wait_inflight();
+    flush_all_puts();
+
+    // All clients wait until all clients sync
+    barrier();
+
+    if ((options.cache_size > 0 && options.cache_invalidation == DHT_CACHE_PUSH) ||
+            options.hot_threshold > 0)
+    {
+        // Every put and get has been applied, so every invalidation and
+        // replica has been sent; once all are acknowledged no cache or
+        // replica holds an old value and none is still on its way
+        unsigned long start = metrics_now_ns();
+        pthread_mutex_lock(&approve_lock);
+        while (pending_invalidations > 0)
+        {
+            wait_approval();
+        }
+        pthread_mutex_unlock(&approve_lock);
+        count_wait(METRIC_CONFIRM_WAIT_NS, start);
+        replica_settle();
+        barrier();
+    }
+    if (options.cache_size > 0 && options.cache_invalidation == DHT_CACHE_EPOCH)
+    {
+        // A new epoch starts with an empty cache
+        cache_clear();
+    }
+}
+
+void dht_sync()
+{
+    sync_all();
+    if (options.migrate_threshold > 0)
+    {
+        migrate_keys();
+    }
+}
+
+void dht_destroy(FILE *output)
+{
+    // Wait for all threads; no key needs to move any more
+    sync_all();
+
+    if (options.backend == DHT_BACKEND_RMA)
+    {
+        // Dump this process's slots through the local table
+        rma_export();
+        local_destroy(save_outputs() ? NULL : output);
+        write_stats();
+        rma_destroy();
+        free(put_buffers);
+        free(pending_batches);
+        free(free_tags);
+        free(inflight);
+        ring_destroy(&ring);
+        range_destroy(&ranges);
+        locality_destroy();
+        MPI_Comm_free(&reply_comm);
+        MPI_Finalize();
+        return;
+    }
+
+    local_destroy(save_outputs() ? NULL : output);
+
+    if (options.progress)
+    {
+        // Every process is past the final barrier, so nothing more is
+        // coming; serve what is left and withdraw every receive
+        progress();
+        for (int i = 0; i < options.server_threads; i++)
+        {
+            stop_worker(&workers[i], RECVS_PER_WORKER);
+        }
+    }
+    else
+    {
+        // Sends a message to each worker that the server is terminating
+        for (int i = 0; i < options.server_threads; i++)
+        {
+            MPI_Send(NULL, 0, MPI_BYTE, rank, DESTROY, workers[i].comm);
+        }
+        for (int i = 0; i < options.server_threads; i++)
+        {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    write_stats();
+
+    // Clean up
+    for (int i = 0; i < options.server_threads; i++)
+    {
+        for (int r = 0; r < RECVS_PER_WORKER; r++)
+        {
+            free(workers[i].bufs[r]);
+        }
+        MPI_Comm_free(&workers[i].comm);
+        sketch_destroy(&workers[i].sketch);
+    }
+    free(workers);
+    for (int i = 0; i < nprocs * options.server_threads; i++)
+    {
+        free(put_buffers[i].data);
+        free(put_buffers[i].inflight);
+    }
+    free(put_buffers);
+    free(pending_batches);
+    free(free_tags);
+    free(inflight);
+    cache_destroy();
+    replica_destroy();
+    ring_destroy(&ring);
+    range_destroy(&ranges);
+    locality_destroy();
+    MPI_Comm_free(&reply_comm);
+    MPI_Finalize();
+}
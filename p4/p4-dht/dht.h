@@ -3,10 +3,10 @@
  *
  * CS 470 Project 4
  *
- * Public interface for distributed hash table (DHT).
- *
- * DO NOT CHANGE THIS FILE!
- *
+ * Public interface for distributed hash table (DHT). The original calls
+ * (dht_init, dht_put, dht_get, dht_size, dht_sync, dht_destroy) keep their
+ * signatures and meaning, so the unchanged driver still works; everything
+ * else is an extension selected through dht_options or called explicitly.
  */
 
 #ifndef __DHT_H
@@ -14,16 +14,157 @@
 
 #include <stdlib.h>
 
+#include "cache.h"
 #include "local.h"
+#include "replica.h"
+#include "ring.h"
+
+/*
+ * Options chosen when the hash table is initialized. dht_default_options()
+ * fills in the defaults, which can be overridden through the environment
+ * variables noted below so the unchanged driver can select them.
+ */
+struct dht_options {
+    bool async_put;         // buffer puts per owner and send them in batches;
+                            // they are only guaranteed visible after
+                            // dht_sync (DHT_ASYNC_PUT)
+    size_t put_batch;       // puts per batch message (DHT_PUT_BATCH)
+    int server_threads;     // server worker threads per process; must be the
+                            // same on every process (DHT_SERVER_THREADS)
+    bool progress;          // message backend: start no server threads;
+                            // each process serves the requests for its keys
+                            // from inside its own DHT calls instead, so MPI
+                            // only needs MPI_THREAD_FUNNELED; chosen anyway
+                            // if MPI_THREAD_MULTIPLE is not provided
+                            // (DHT_PROGRESS)
+    size_t cache_size;      // remote values each process caches for dht_get;
+                            // zero disables the cache (DHT_CACHE_SIZE)
+    int cache_invalidation; // DHT_CACHE_EPOCH or DHT_CACHE_PUSH
+                            // (DHT_CACHE_INVALIDATE=epoch|push)
+    int placement;          // DHT_PLACEMENT_RING, DHT_PLACEMENT_MODULO or
+                            // DHT_PLACEMENT_RANGE
+                            // (DHT_PLACEMENT=ring|modulo|range)
+    int vnodes;             // ring points per process (DHT_VNODES)
+    ring_hash_fn hash;      // key hash used for placement
+                            // (DHT_HASH=djb2|fnv1a|murmur)
+    const char *range_sample; // range placement: dht_init chooses the
+                              // splitters from the keys of this file of
+                              // "key value" or "put key value" lines;
+                              // without it keys are placed by hash until
+                              // the first dht_bulk_load or dht_rebalance
+                              // chooses them (DHT_RANGE_SAMPLE)
+    double rebalance_skew;  // range placement: dht_rebalance moves the
+                            // splitters once the largest process holds
+                            // more than this many times the mean number of
+                            // pairs (DHT_REBALANCE_SKEW)
+    int backend;            // DHT_BACKEND_MESSAGE or DHT_BACKEND_RMA
+                            // (DHT_BACKEND=message|rma)
+    size_t rma_slots;       // key slots each process exposes in the RMA
+                            // backend; fixed for the run (DHT_RMA_SLOTS)
+    bool shm;               // RMA backend: processes on the same node share
+                            // their slots through shared memory and access
+                            // them with plain loads and stores (DHT_SHM)
+    const char *snapshot;   // if set, dht_destroy saves each process's pairs
+                            // to <snapshot>-NNN.snap instead of dumping them
+                            // as text (DHT_SNAPSHOT)
+    const char *restore;    // if set, dht_init maps <restore>-NNN.snap as the
+                            // starting contents; needs the same process count
+                            // and placement, message backend only
+                            // (DHT_RESTORE)
+    const char *dump_file;  // if set, dht_destroy writes all processes' pairs
+                            // to this one file with MPI-IO instead of the
+                            // text dumps (DHT_DUMP_FILE)
+    int dump_layout;        // DUMP_TEXT (globally sorted) or DUMP_BINARY
+                            // (DHT_DUMP_LAYOUT=text|binary), see dump.h
+    int hot_threshold;      // if positive, an owner replicates a key to
+                            // every process once it has served about this
+                            // many recent gets of it; zero disables hot-key
+                            // replication (DHT_HOT_THRESHOLD)
+    size_t hot_replicas;    // replicas each process keeps (DHT_HOT_REPLICAS)
+    int migrate_threshold;  // if positive, dht_sync moves a key to the
+                            // process that accesses it most once that
+                            // process leads the other accessors by this
+                            // many accesses since the last dht_sync; zero
+                            // disables key migration (DHT_MIGRATE_THRESHOLD)
+    size_t migrate_tracked; // keys each process tracks accesses of
+                            // (DHT_MIGRATE_TRACKED)
+    const char *stats_file; // dht_destroy writes every process's counters
+                            // (see metrics.h) to this JSON file; defaults to
+                            // dht-stats.json, empty disables the report
+                            // (DHT_STATS_FILE)
+};
+
+/*
+ * Backends. DHT_BACKEND_MESSAGE sends every operation to a server thread on
+ * the owner. DHT_BACKEND_RMA reads and writes the owner's memory directly
+ * with one-sided MPI operations and starts no server thread; puts are never
+ * batched and the read cache is not used.
+ *
+ * With the progress option the message backend starts no server thread
+ * either: every DHT call (and every wait inside one) first serves the
+ * requests that have arrived for this process. A process therefore only
+ * serves others while it is in a DHT call, and one that computes for long
+ * between calls delays the processes waiting on it. Call dht_sync before
+ * waiting for other processes outside the DHT (in an MPI collective, say),
+ * or one may wait forever for a reply from a process that has stopped
+ * serving.
+ */
+#define DHT_BACKEND_MESSAGE 0
+#define DHT_BACKEND_RMA 1
+
+/*
+ * Key placement. DHT_PLACEMENT_RING places keys on a consistent-hash ring
+ * (see ring.h); DHT_PLACEMENT_MODULO is the original hash % nprocs.
+ * DHT_PLACEMENT_RANGE gives every process a contiguous slice of the key
+ * space (see range.h), so scans only ask the processes whose slices they
+ * overlap; it cannot restore a snapshot. The slices are cut where a sample of
+ * keys says: the range sample file, else the keys of the first dht_bulk_load
+ * (which moves the pairs already stored into their slices; with the RMA
+ * backend only if none are), else every key at the first dht_rebalance.
+ * Until then keys are placed by hash % nprocs and scans ask every process.
+ * Every process must use the same placement, virtual nodes, hash and range
+ * sample.
+ */
+#define DHT_PLACEMENT_RING 0
+#define DHT_PLACEMENT_MODULO 1
+#define DHT_PLACEMENT_RANGE 2
+
+/*
+ * Cache invalidation modes. With DHT_CACHE_EPOCH every cache is emptied at
+ * dht_sync, so a dht_get may return a value overwritten by another process
+ * since the last dht_sync. With DHT_CACHE_PUSH an owner tells the processes
+ * it handed a value out to when the value changes; dht_sync waits until all
+ * of those messages have been applied, and caches survive it.
+ */
+#define DHT_CACHE_EPOCH 0
+#define DHT_CACHE_PUSH 1
+
+void dht_default_options(struct dht_options *opts);
 
 /*
  * Initialize a new hash table. Returns the current process ID (always zero in
  * the serial version)
  *
- * (In the parallel version, this should spawn the server thread.)
+ * (In the parallel version, this should spawn the server threads.)
  */
 int dht_init();
 
+/*
+ * Same as dht_init(), but with explicit options.
+ */
+int dht_init_opts(const struct dht_options *opts);
+
+/*
+ * Client threads (message backend; with DHT_BACKEND_RMA or progress only the
+ * thread that called dht_init may use the DHT). Any number of threads of a
+ * process may call dht_put, dht_get, dht_iget, dht_iput, dht_get_many, the
+ * atomic updates, the scans and dht_size concurrently; every reply is matched to
+ * its caller by a reply tag of its own. A request must be tested or waited
+ * for by the thread that started it. dht_sync, dht_bulk_load,
+ * dht_rebalance and dht_destroy must be called by one thread while no other
+ * thread of the process is in a DHT call.
+ */
+
 /*
  * Save a key-value association. If the key already exists, the associated value
  * is changed in the hash table. If the key does not already exist, a new pair
@@ -43,6 +184,116 @@ void dht_put(const char *key, long value);
  */
 long dht_get(const char *key);
 
+/*
+ * Non-blocking gets and puts. dht_iget and dht_iput start the operation and
+ * return a handle at once, so many operations can be in flight while the
+ * caller computes; each waits for its own reply. A get stores its value in
+ * *value_out, which must stay valid until the request completes. dht_test
+ * returns whether a request is complete and dht_wait blocks until it is;
+ * either one frees a complete request and sets the handle to NULL (a NULL
+ * handle counts as complete). dht_sync completes every request in flight,
+ * but the handles must still be freed with dht_test or dht_wait.
+ */
+struct dht_request;
+
+struct dht_request *dht_iget(const char *key, long *value_out);
+struct dht_request *dht_iput(const char *key, long value);
+bool dht_test(struct dht_request **req);
+void dht_wait(struct dht_request **req);
+void dht_waitall(struct dht_request **reqs, size_t n);
+
+/*
+ * Retrieve the values for n keys at once; values_out[i] receives the value
+ * for keys[i] (or KEY_NOT_FOUND). Keys are grouped by owner and every owner
+ * is queried concurrently with a single request.
+ */
+void dht_get_many(const char **keys, size_t n, long *values_out);
+
+/*
+ * Atomic read-modify-write operations. Each is applied by the key's owner as
+ * one step, so concurrent updates from any number of processes are never
+ * lost; one round trip replaces a dht_get followed by a dht_put.
+ *
+ * dht_add adds delta to the value (a missing key counts as zero) and returns
+ * the new value. dht_compare_and_swap stores desired if the value equals
+ * expected (pass KEY_NOT_FOUND to create a missing key only), and
+ * dht_fetch_max stores value if the key is missing or holds a smaller value;
+ * both return the value before the call (KEY_NOT_FOUND if there was none).
+ */
+long dht_add(const char *key, long delta);
+long dht_compare_and_swap(const char *key, long expected, long desired);
+long dht_fetch_max(const char *key, long value);
+
+/*
+ * dht_add for n keys at once: the increments for one owner travel in a single
+ * message. new_values_out[i] receives the new value of keys[i] (it may be
+ * NULL); a key that appears several times is added to each time.
+ */
+void dht_add_many(const char **keys, const long *deltas, size_t n, long *new_values_out);
+
+/*
+ * Key scans, in key order (the byte order of the dump). dht_scan_range calls
+ * callback(key, value, arg) for every pair with lo <= key < hi (a NULL bound
+ * is open), and dht_scan_prefix for every pair whose key starts with prefix;
+ * both return the number of pairs. Every owner scans its part at once and
+ * streams it back in chunks, which the caller merges as they arrive. Puts
+ * this process made before the call are seen; pairs other processes put
+ * during the scan may or may not be. The key is only valid during the call.
+ */
+typedef void (*dht_scan_fn)(const char *key, long value, void *arg);
+
+size_t dht_scan_range(const char *lo, const char *hi, dht_scan_fn callback, void *arg);
+size_t dht_scan_prefix(const char *prefix, dht_scan_fn callback, void *arg);
+
+/*
+ * Load a file of "key value" lines (or "put key value" lines; other lines
+ * are skipped) into the DHT, as if every line were a dht_put in file order.
+ * Collective: each process parses a slice of the file, all pairs travel to
+ * their owners in a single all-to-all exchange, and each owner builds its
+ * part of the table directly. Every pair is visible once it returns. Returns
+ * the number of pairs loaded, or -1 if a process cannot read the file.
+ */
+long dht_bulk_load(const char *path);
+
+/*
+ * Range placement, message backend: if no splitters have been chosen yet, or
+ * the shards have drifted apart (see rebalance_skew), choose new splitters
+ * from a sample of every process's keys and move each pair to its new owner.
+ * Collective; everything issued before the call is moved with it, and caches
+ * and replicas are emptied. Returns the number of pairs that changed owner
+ * (zero if the shards were close enough), or -1 with another placement or
+ * backend.
+ */
+long dht_rebalance();
+
+/*
+ * Cache counters of this process (all zero when the cache is disabled)
+ */
+void dht_cache_stats(struct cache_stats *stats);
+
+/*
+ * Hot-key replication (message backend). Each server worker estimates how
+ * often each key is requested with a count-min sketch (see sketch.h); keys
+ * that pass hot_threshold are sent to every process, which answers dht_get
+ * for them locally (see replica.h). A put or update of a replicated key
+ * invalidates the replicas, with the same guarantees as DHT_CACHE_PUSH.
+ * These are this process's replica counters (all zero when replication is
+ * disabled).
+ */
+void dht_replica_stats(struct replica_stats *stats);
+
+/*
+ * Key migration (message backend, hash placement). Owners track which
+ * process accesses each key most (see locality.h); at the end of dht_sync,
+ * every key whose dominant accessor is another process moves there, so that
+ * process's operations on it need no message. Every process keeps the same
+ * directory of moved keys, so no lookup is ever sent to a former owner.
+ * Caches and replicas are emptied whenever keys have moved. Migration is off
+ * when a snapshot is to be saved (DHT_SNAPSHOT), since the directory is not
+ * part of it. The stats report (see metrics.h) counts the operations each
+ * process kept local and the keys migrated per dht_sync.
+ */
+
 /*
  * Returns the total size of the DHT.
  *
@@ -54,6 +305,8 @@ size_t dht_size();
 /*
  * Synchronize all client processes involved in the DHT. This function should
  * not return until other all client processes have also called this function.
+ * Every put issued before the call is visible once it returns, and keys
+ * migrate during it (see migrate_threshold).
  *
  * (In the parallel version, this should essentially be a global barrier.)
  */
@@ -62,7 +315,7 @@ void dht_sync();
 /*
  * Dump contents and clean up the hash table.
  *
- * (In the parallel version, this should terminate the server thread.)
+ * (In the parallel version, this should terminate the server threads.)
  */
 void dht_destroy(FILE *output);
 
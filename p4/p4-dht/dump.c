@@ -0,0 +1,181 @@
+/**
+ * dump.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the collective MPI-IO dump (see dump.h).
+ */
+
+#include <inttypes.h>
+
+#include "dump.h"
+
+/*
+ * Helper function: ordering of fixed-size keys
+ */
+static int compare_keys(const void *a, const void *b)
+{
+    return strncmp((const char *)a, (const char *)b, MAX_KEYLEN);
+}
+
+/*
+ * Helper function: write bytes at offset on every process at once. Returns
+ * whether all of them succeeded.
+ */
+static bool write_all(MPI_Comm comm, MPI_File fh, MPI_Offset offset,
+        const void *data, size_t bytes)
+{
+    int ok = MPI_File_write_at_all(fh, offset, data, (int)bytes, MPI_BYTE,
+            MPI_STATUS_IGNORE) == MPI_SUCCESS;
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, comm);
+    return all_ok;
+}
+
+/*
+ * Helper function: binary layout
+ */
+static bool dump_binary(MPI_Comm comm, MPI_File fh,
+        const struct snapshot_pair *pairs, size_t count)
+{
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    uint64_t mine = count;
+    uint64_t *counts = malloc(nprocs * sizeof(uint64_t));
+    MPI_Allgather(&mine, 1, MPI_UINT64_T, counts, 1, MPI_UINT64_T, comm);
+
+    // rank 0 writes the header and count table; the others write nothing
+    struct dump_header header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, DUMP_MAGIC);
+    header.format = DUMP_FORMAT;
+    header.keylen = MAX_KEYLEN;
+    header.nprocs = (uint32_t)nprocs;
+    for (int i = 0; i < nprocs; i++) {
+        header.pair_count += counts[i];
+    }
+    size_t table_bytes = sizeof(header) + nprocs * sizeof(uint64_t);
+    char *table = malloc(table_bytes);
+    memcpy(table, &header, sizeof(header));
+    memcpy(table + sizeof(header), counts, nprocs * sizeof(uint64_t));
+    bool ok = write_all(comm, fh, 0, table, rank == 0 ? table_bytes : 0);
+    free(table);
+    free(counts);
+
+    // each process's pairs follow those of the processes before it
+    uint64_t before = 0;
+    MPI_Exscan(&mine, &before, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) {
+        before = 0;
+    }
+    MPI_Offset offset = (MPI_Offset)(table_bytes + before * sizeof(struct snapshot_pair));
+    return write_all(comm, fh, offset, pairs, count * sizeof(struct snapshot_pair)) && ok;
+}
+
+/*
+ * Helper function: globally sorted text layout
+ */
+static bool dump_text(MPI_Comm comm, MPI_File fh,
+        struct snapshot_pair *pairs, size_t count)
+{
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    // sample nprocs evenly spaced keys from every process (empty keys sort
+    // first, so a process with no pairs does not disturb the splitters)
+    char (*samples)[MAX_KEYLEN] = calloc(nprocs, MAX_KEYLEN);
+    for (int i = 0; i < nprocs && count > 0; i++) {
+        memcpy(samples[i], pairs[(size_t)i * count / nprocs].key, MAX_KEYLEN);
+    }
+    char (*all_samples)[MAX_KEYLEN] = malloc((size_t)nprocs * nprocs * MAX_KEYLEN);
+    MPI_Allgather(samples, nprocs * MAX_KEYLEN, MPI_CHAR,
+            all_samples, nprocs * MAX_KEYLEN, MPI_CHAR, comm);
+    qsort(all_samples, (size_t)nprocs * nprocs, MAX_KEYLEN, compare_keys);
+
+    // process p receives the keys from splitter p-1 up to (but excluding)
+    // splitter p; pairs are
+    // sorted, so each destination gets one contiguous run
+    int *send_counts = calloc(nprocs, sizeof(int));
+    int *send_displs = calloc(nprocs, sizeof(int));
+    size_t next = 0;
+    for (int p = 0; p < nprocs; p++) {
+        size_t end = count;
+        if (p < nprocs - 1) {
+            const char *splitter = all_samples[(size_t)(p + 1) * nprocs];
+            end = next;
+            while (end < count && strncmp(pairs[end].key, splitter, MAX_KEYLEN) < 0) {
+                end++;
+            }
+        }
+        send_displs[p] = (int)(next * sizeof(struct snapshot_pair));
+        send_counts[p] = (int)((end - next) * sizeof(struct snapshot_pair));
+        next = end;
+    }
+    free(samples);
+    free(all_samples);
+
+    int *recv_counts = malloc(nprocs * sizeof(int));
+    int *recv_displs = malloc(nprocs * sizeof(int));
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    size_t recv_bytes = 0;
+    for (int p = 0; p < nprocs; p++) {
+        recv_displs[p] = (int)recv_bytes;
+        recv_bytes += recv_counts[p];
+    }
+    struct snapshot_pair *range = malloc(recv_bytes + 1);
+    MPI_Alltoallv(pairs, send_counts, send_displs, MPI_BYTE,
+            range, recv_counts, recv_displs, MPI_BYTE, comm);
+    size_t range_count = recv_bytes / sizeof(struct snapshot_pair);
+    qsort(range, range_count, sizeof(struct snapshot_pair), compare_keys);
+
+    // format this process's lines and write them after everyone before it
+    size_t cap = range_count * (MAX_KEYLEN + 40) + 1;
+    char *text = malloc(cap);
+    size_t used = 0;
+    for (size_t i = 0; i < range_count; i++) {
+        used += snprintf(text + used, cap - used, "  Key=\"%s\" Value=%" PRId64 "\n",
+                range[i].key, range[i].value);
+    }
+    uint64_t mine = used;
+    uint64_t before = 0;
+    MPI_Exscan(&mine, &before, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) {
+        before = 0;
+    }
+    bool ok = write_all(comm, fh, (MPI_Offset)before, text, used);
+
+    free(text);
+    free(range);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    return ok;
+}
+
+bool dump_collective(MPI_Comm comm, const char *path, int layout,
+        struct snapshot_pair *pairs, size_t count)
+{
+    MPI_File fh;
+    int opened = MPI_File_open(comm, path, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+            MPI_INFO_NULL, &fh) == MPI_SUCCESS;
+    int all_opened;
+    MPI_Allreduce(&opened, &all_opened, 1, MPI_INT, MPI_LAND, comm);
+    if (!all_opened) {
+        if (opened) {
+            MPI_File_close(&fh);
+        }
+        return false;
+    }
+
+    // an older, longer dump must not leave bytes behind
+    MPI_File_set_size(fh, 0);
+
+    bool ok = layout == DUMP_TEXT ? dump_text(comm, fh, pairs, count)
+        : dump_binary(comm, fh, pairs, count);
+    MPI_File_close(&fh);
+    return ok;
+}
@@ -0,0 +1,51 @@
+/**
+ * dump.h
+ *
+ * CS 470 Project 4
+ *
+ * Collective dump of the whole DHT into a single file with MPI-IO. Every
+ * process contributes its pairs; each one's place in the file comes from an
+ * exclusive prefix sum of the sizes before it, and all processes write with
+ * one MPI_File_write_at_all.
+ *
+ * Binary layout: a struct dump_header, then one uint64_t pair count per
+ * process, then every process's pairs (struct snapshot_pair) in rank order,
+ * each process's pairs sorted by key.
+ *
+ * Text layout: the dump file lines ("  Key=... Value=...") of all pairs,
+ * sorted by key across all processes; the pairs are first redistributed by
+ * key range with a sample sort.
+ */
+
+#ifndef __DUMP_H
+#define __DUMP_H
+
+#include <mpi.h>
+#include <stdint.h>
+
+#include "snapshot.h"
+
+#define DUMP_BINARY 0
+#define DUMP_TEXT 1
+
+#define DUMP_MAGIC "DHTDUMP"
+#define DUMP_FORMAT 1
+
+struct dump_header {
+    char magic[8];          // DUMP_MAGIC, NUL-terminated
+    uint32_t format;        // DUMP_FORMAT
+    uint32_t keylen;        // MAX_KEYLEN of the writer
+    uint32_t nprocs;        // number of pair counts that follow
+    uint32_t reserved;
+    uint64_t pair_count;    // total over all processes
+};
+
+/*
+ * Write the pairs of every process in comm to path (collective). pairs must
+ * be sorted by key; they may be reordered. Returns false on every process if
+ * the file could not be written.
+ */
+bool dump_collective(MPI_Comm comm, const char *path, int layout,
+        struct snapshot_pair *pairs, size_t count);
+
+#endif
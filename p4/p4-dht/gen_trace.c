@@ -0,0 +1,196 @@
+/**
+ * gen_trace.c
+ *
+ * CS 470 Project 4
+ *
+ * Synthetic workload generator. Writes a trace in the input file format
+ * (proc/put/get/size/sync) to stdout: for every process, a section of random
+ * puts and gets followed by a sync and a size.
+ *
+ * Usage: gen_trace [options] <nprocs> <ops-per-process>
+ *
+ *   -k <keys>       number of distinct keys (default 100000)
+ *   -d <dist>       key popularity: uniform or zipf (default uniform)
+ *   -s <skew>       Zipf exponent (default 0.99)
+ *   -r <ratio>      fraction of operations that are gets (default 0.5)
+ *   -l <min>:<max>  key length range in characters, 1..63 (default 8:8);
+ *                   each key keeps its length throughout the trace
+ *   -x <seed>       random seed (default 1)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "local.h"
+
+/*
+ * Random numbers (xorshift64*; fast and good enough for workloads)
+ */
+static uint64_t rng_state;
+
+static uint64_t rng_next()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static double rng_uniform()
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Helper function: scramble a key number (so key lengths do not follow
+ * popularity)
+ */
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+ * Helper function: text of key number id, between min_len and max_len
+ * characters long (or longer, if that is too short to hold the number)
+ */
+static void make_key(char *key, uint64_t id, int min_len, int max_len)
+{
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    uint64_t h = mix(id);
+    int len = min_len + (int)(h % (uint64_t)(max_len - min_len + 1));
+
+    // the key number in base 36 makes the key unique; after a separator the
+    // rest is filler
+    char id_text[16];
+    int n = 0;
+    do {
+        id_text[n++] = digits[id % 36];
+        id /= 36;
+    } while (id > 0);
+    int i = 0;
+    while (n > 0) {
+        key[i++] = id_text[--n];
+    }
+    if (i < len) {
+        key[i++] = '_';
+    }
+    while (i < len) {
+        key[i] = digits[(h >> (i % 12 * 5)) % 36];
+        i++;
+    }
+    key[i] = '\0';
+}
+
+/*
+ * Zipf distribution over key ranks 1..n, sampled from its cumulative
+ * distribution by binary search
+ */
+static double *zipf_cdf;
+
+static void zipf_init(uint64_t n, double skew)
+{
+    zipf_cdf = malloc(n * sizeof(double));
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        sum += 1.0 / pow((double)(i + 1), skew);
+        zipf_cdf[i] = sum;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        zipf_cdf[i] /= sum;
+    }
+}
+
+static uint64_t zipf_next(uint64_t n)
+{
+    double u = rng_uniform();
+    uint64_t lo = 0;
+    uint64_t hi = n - 1;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (zipf_cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t keys = 100000;
+    bool zipf = false;
+    double skew = 0.99;
+    double read_ratio = 0.5;
+    int min_len = 8;
+    int max_len = 8;
+    uint64_t seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:d:s:r:l:x:")) != -1) {
+        switch (opt) {
+            case 'k': keys = strtoull(optarg, NULL, 10); break;
+            case 'd': zipf = strcmp(optarg, "zipf") == 0; break;
+            case 's': skew = strtod(optarg, NULL); break;
+            case 'r': read_ratio = strtod(optarg, NULL); break;
+            case 'l':
+                if (sscanf(optarg, "%d:%d", &min_len, &max_len) == 1) {
+                    max_len = min_len;
+                }
+                break;
+            case 'x': seed = strtoull(optarg, NULL, 10); break;
+            default: argc = 0; break;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-k keys] [-d uniform|zipf] [-s skew] [-r read-ratio]"
+                " [-l min:max] [-x seed] <nprocs> <ops-per-process>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int nprocs = (int)strtol(argv[optind], NULL, 10);
+    long ops = strtol(argv[optind + 1], NULL, 10);
+    if (keys == 0 || min_len < 1 || max_len < min_len || max_len > MAX_KEYLEN-1) {
+        fprintf(stderr, "ERROR: invalid key count or length range\n");
+        return EXIT_FAILURE;
+    }
+
+    if (zipf) {
+        zipf_init(keys, skew);
+    }
+    rng_state = mix(seed) | 1;
+
+    printf("# gen_trace: %d procs, %ld ops each, %lu keys, %s",
+            nprocs, ops, (unsigned long)keys, zipf ? "zipf" : "uniform");
+    if (zipf) {
+        printf(" %.2f", skew);
+    }
+    printf(", %.0f%% gets, key length %d-%d\n", read_ratio * 100, min_len, max_len);
+
+    char key[MAX_KEYLEN];
+    for (int p = 0; p < nprocs; p++) {
+        printf("proc %d\n", p);
+        for (long i = 0; i < ops; i++) {
+            uint64_t id = zipf ? zipf_next(keys) : rng_next() % keys;
+            make_key(key, id, min_len, max_len);
+            if (rng_uniform() < read_ratio) {
+                printf("get %s\n", key);
+            } else {
+                printf("put %s %lu\n", key, (unsigned long)(rng_next() % 1000000));
+            }
+        }
+        printf("sync\nsize\n");
+    }
+    return EXIT_SUCCESS;
+}
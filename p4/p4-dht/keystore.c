@@ -0,0 +1,185 @@
+/**
+ * keystore.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the fixed-capacity keyed store (see keystore.h). The
+ * guard table has four slots per bucket, so unrelated keys seldom share a
+ * guard word.
+ */
+
+#include "keystore.h"
+#include "ring.h"
+
+/*
+ * Helper functions: bucket and guard slot of a key
+ */
+static size_t bucket_of(const struct keystore *store, const char *key)
+{
+    return ring_hash_fnv1a(key) & (store->bucket_count - 1);
+}
+
+static size_t slot_of(const struct keystore *store, const char *key)
+{
+    return ring_hash_fnv1a(key) & (store->guard_count - 1);
+}
+
+/*
+ * Helper functions: LRU list maintenance
+ */
+static void unlink_lru(struct keystore *store, size_t e)
+{
+    struct keystore_entry *entries = store->entries;
+    if (entries[e].newer != KEYSTORE_NONE) {
+        entries[entries[e].newer].older = entries[e].older;
+    } else {
+        store->newest = entries[e].older;
+    }
+    if (entries[e].older != KEYSTORE_NONE) {
+        entries[entries[e].older].newer = entries[e].newer;
+    } else {
+        store->oldest = entries[e].newer;
+    }
+}
+
+static void push_newest(struct keystore *store, size_t e)
+{
+    struct keystore_entry *entries = store->entries;
+    entries[e].newer = KEYSTORE_NONE;
+    entries[e].older = store->newest;
+    if (store->newest != KEYSTORE_NONE) {
+        entries[store->newest].newer = e;
+    }
+    store->newest = e;
+    if (store->oldest == KEYSTORE_NONE) {
+        store->oldest = e;
+    }
+}
+
+/*
+ * Helper function: remove an entry from its bucket chain
+ */
+static void unlink_bucket(struct keystore *store, size_t e)
+{
+    size_t *link = &store->buckets[bucket_of(store, store->entries[e].key)];
+    while (*link != e) {
+        link = &store->entries[*link].bucket_next;
+    }
+    *link = store->entries[e].bucket_next;
+}
+
+void keystore_init(struct keystore *store, size_t capacity, bool lru)
+{
+    store->capacity = capacity;
+    store->lru = lru;
+    store->evictions = 0;
+    store->bucket_count = 1;
+    while (store->bucket_count < capacity) {
+        store->bucket_count *= 2;
+    }
+    store->guard_count = 4 * store->bucket_count;
+    if (capacity == 0) {
+        store->entries = NULL;
+        store->buckets = NULL;
+        store->guards = NULL;
+        store->used = 0;
+        return;
+    }
+    store->entries = malloc(capacity * sizeof(struct keystore_entry));
+    store->buckets = malloc(store->bucket_count * sizeof(size_t));
+    store->guards = calloc(store->guard_count, sizeof(unsigned long));
+    keystore_clear(store);
+}
+
+size_t keystore_find(const struct keystore *store, const char *key)
+{
+    if (store->capacity == 0) {
+        return KEYSTORE_NONE;
+    }
+    for (size_t e = store->buckets[bucket_of(store, key)]; e != KEYSTORE_NONE;
+            e = store->entries[e].bucket_next) {
+        if (strncmp(store->entries[e].key, key, MAX_KEYLEN-1) == 0) {
+            return e;
+        }
+    }
+    return KEYSTORE_NONE;
+}
+
+size_t keystore_add(struct keystore *store, const char *key)
+{
+    struct keystore_entry *entries = store->entries;
+    size_t e;
+    if (store->used < store->capacity) {
+        e = store->used++;
+    } else {
+        if (store->lru) {
+            e = store->oldest;
+            unlink_lru(store, e);
+        } else {
+            e = store->hand;
+            store->hand = (store->hand + 1) % store->capacity;
+        }
+        unlink_bucket(store, e);
+        if (entries[e].valid) {
+            store->evictions++;
+        }
+    }
+    size_t len = 0;
+    while (len < MAX_KEYLEN-1 && key[len] != '\0') {
+        len++;
+    }
+    memcpy(entries[e].key, key, len);
+    entries[e].key[len] = '\0';
+    entries[e].valid = false;
+    entries[e].version = 0;
+    size_t bucket = bucket_of(store, key);
+    entries[e].bucket_next = store->buckets[bucket];
+    store->buckets[bucket] = e;
+    if (store->lru) {
+        push_newest(store, e);
+    }
+    return e;
+}
+
+void keystore_touch(struct keystore *store, size_t e)
+{
+    if (store->lru) {
+        unlink_lru(store, e);
+        push_newest(store, e);
+    }
+}
+
+unsigned long *keystore_guard(struct keystore *store, const char *key)
+{
+    return &store->guards[slot_of(store, key)];
+}
+
+void keystore_clear(struct keystore *store)
+{
+    for (size_t b = 0; store->buckets != NULL && b < store->bucket_count; b++) {
+        store->buckets[b] = KEYSTORE_NONE;
+    }
+    store->used = 0;
+    store->newest = KEYSTORE_NONE;
+    store->oldest = KEYSTORE_NONE;
+    store->hand = 0;
+}
+
+void keystore_reset_guards(struct keystore *store)
+{
+    if (store->guards != NULL) {
+        memset(store->guards, 0, store->guard_count * sizeof(unsigned long));
+    }
+}
+
+void keystore_destroy(struct keystore *store)
+{
+    free(store->entries);
+    free(store->buckets);
+    free(store->guards);
+    store->entries = NULL;
+    store->buckets = NULL;
+    store->guards = NULL;
+    store->capacity = 0;
+    store->used = 0;
+}
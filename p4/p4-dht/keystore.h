@@ -0,0 +1,83 @@
+/**
+ * keystore.h
+ *
+ * CS 470 Project 4
+ *
+ * Fixed-capacity store of keyed values, shared by the read cache and the
+ * replica store. Entries live in one preallocated array and are found
+ * through chained hash buckets; once every entry is in use, adding a key
+ * reuses either the least recently used entry or the one under a clock
+ * hand. Beside the entries is a table of guard words, one per hash slot,
+ * that is never evicted: what a caller must remember about a key past the
+ * eviction of its entry goes there (keys in the same slot share a word). A
+ * keystore is not locked; its user holds a lock around every call.
+ */
+
+#ifndef __KEYSTORE_H
+#define __KEYSTORE_H
+
+#include "local.h"
+
+#define KEYSTORE_NONE ((size_t)-1)
+
+struct keystore_entry {
+    char key[MAX_KEYLEN];
+    long value;
+    unsigned long version;
+    bool valid;                 // false once the value has been dropped
+    size_t bucket_next;         // next entry in the same bucket
+    size_t newer;               // LRU list neighbours
+    size_t older;
+};
+
+struct keystore {
+    struct keystore_entry *entries;
+    size_t *buckets;
+    unsigned long *guards;      // guard words, by slot
+    size_t capacity;
+    size_t bucket_count;        // power of two
+    size_t guard_count;         // power of two
+    size_t used;                // entries handed out so far
+    bool lru;                   // reuse the least recently used entry
+    size_t newest;
+    size_t oldest;
+    size_t hand;                // next entry to reuse, if not lru
+    unsigned long evictions;    // valid entries reused for another key
+};
+
+/*
+ * Make room for capacity entries (none at all if capacity is zero), reused
+ * in least-recently-used order if lru is set and by a clock hand otherwise
+ */
+void keystore_init(struct keystore *store, size_t capacity, bool lru);
+
+/*
+ * Entry for a key, or KEYSTORE_NONE
+ */
+size_t keystore_find(const struct keystore *store, const char *key);
+
+/*
+ * Entry for a key that has none yet, with no valid value; another key's
+ * entry is reused if the store is full
+ */
+size_t keystore_add(struct keystore *store, const char *key);
+
+/*
+ * Mark an entry as the most recently used
+ */
+void keystore_touch(struct keystore *store, size_t e);
+
+/*
+ * Guard word of a key's slot (zero until first set)
+ */
+unsigned long *keystore_guard(struct keystore *store, const char *key);
+
+/*
+ * Drop every entry (keystore_reset_guards zeroes the guard words)
+ */
+void keystore_clear(struct keystore *store);
+void keystore_reset_guards(struct keystore *store);
+
+void keystore_destroy(struct keystore *store);
+
+#endif
@@ -5,57 +5,481 @@
  *
  * Implementation for local key-value lookup table.
  *
- * DO NOT CHANGE THIS FILE!
+ * The table is an open-addressing hash table (linear probing) over a dense
+ * sequence of pairs. Lookups and inserts are O(1) on average; the pairs are
+ * only sorted once, when the table is dumped, so the output stays
+ * lexicographic.
+ *
+ * Storage grows on demand: pairs are carved out of fixed-size chunks (an
+ * arena) that are allocated only when the previous chunk fills up, and the
+ * hash slots double whenever the load factor would pass one half. Nothing is
+ * allocated until the first insert.
+ *
+ * Keys are interned rather than stored in a MAX_KEYLEN buffer per pair:
+ * short keys live inline in the pair, and longer ones are appended once,
+ * length-prefixed, to a per-shard key arena that the pair points into. The
+ * arena only grows: the bytes of a removed key stay in it until the table is
+ * released.
+ *
+ * The table is split into LOCAL_SHARDS independent shards chosen by the top
+ * bits of the key hash, each with its own lock, so several server threads
+ * can work on the table at once.
+ *
+ * A table restored from a snapshot keeps the mapped snapshot as a read-only
+ * base layer: lookups that miss the in-memory shards fall through to the
+ * snapshot's index, and puts go to the shards, shadowing the snapshot.
  */
 
+#include <pthread.h>
+#include <stdint.h>
+
 #include "local.h"
+#include "snapshot.h"
+
+/*
+ * Number of pairs per arena chunk
+ */
+#define CHUNK_PAIRS 1024
 
-#define MAX_LOCAL_PAIRS 65536
+/*
+ * Initial number of hash slots; must be a power of two
+ */
+#define MIN_SLOTS 1024
+
+/*
+ * Bytes per key arena chunk; a chunk always has room for the longest key
+ */
+#define KEY_CHUNK_BYTES 65536
+
+/*
+ * Keys shorter than this are stored inline in their pair
+ */
+#define INLINE_KEYLEN 14
 
 /*
- * Private module structure: holds data for a single key-value pair
+ * Private module structure: holds data for a single key-value pair (32
+ * bytes). A key of keylen < INLINE_KEYLEN characters is stored in key with
+ * its terminator; a longer key is in the shard's key arena, and key holds
+ * its uint32_t arena offset instead.
  */
 struct kv_pair {
-    char key[MAX_KEYLEN];
     long value;
+    unsigned long version;      // stamped from the shard's counter on each put
+    uint8_t keylen;             // length of the key, compared before its bytes
+    bool shared;                // version was handed out to a remote cache
+                                // (which ones: see sharer_chunks)
+    char key[INLINE_KEYLEN];
 };
 
 /*
- * Private module variable: array that stores all local key-value pairs
- *
- * NOTE: the pairs are stored lexicographically by key for cleaner output
+ * Private module structure: one hash slot. Slots are kept small (8 bytes) so a
+ * probe sequence touches as few cache lines as possible; the full key is only
+ * compared when the stored hash matches.
+ */
+struct slot {
+    uint32_t hash;      // full hash of the key stored in this slot
+    uint32_t index;     // pair index plus one (zero means empty)
+};
+
+/*
+ * Number of bits of the key hash used to pick a shard
+ */
+#define SHARD_BITS 4
+
+/*
+ * Private module structure: one shard of the table. Pair i lives at
+ * chunks[i / CHUNK_PAIRS][i % CHUNK_PAIRS]; chunks are never moved, so
+ * growing the table only copies chunk pointers and slots. A long key at
+ * arena offset o is the length byte key_chunks[o / KEY_CHUNK_BYTES][o %
+ * KEY_CHUNK_BYTES], followed by the key and its terminator.
+ */
+struct table {
+    struct kv_pair **chunks;    // arena chunks, in allocation order
+    size_t chunk_count;         // number of allocated chunks
+    size_t chunk_cap;           // capacity of the chunks pointer array
+    uint64_t **sharer_chunks;   // processes holding each shared pair, by
+                                // chunk (NULL until one of its pairs is shared)
+    size_t sharer_chunk_count;  // number of allocated sharer chunks
+    char **key_chunks;          // key arena chunks, in allocation order
+    size_t key_chunk_count;     // number of allocated key chunks
+    size_t key_chunk_cap;       // capacity of the key_chunks pointer array
+    size_t key_used;            // bytes used in the last key chunk
+    struct slot *slots;         // hash slots (NULL until the first insert)
+    size_t slot_count;          // number of hash slots (power of two)
+    size_t pair_count;          // current number of actual key-value pairs
+    unsigned long last_version; // last version stamped on a pair
+    pthread_mutex_t lock;       // guards everything above
+};
+
+/*
+ * Private module variable: the shards of the local table
+ */
+static struct table tables[LOCAL_SHARDS];
+static bool tables_initialized;
+
+/*
+ * Private module variables: bytes currently allocated for all shards and
+ * their high-water mark (updated atomically)
+ */
+static size_t total_bytes;
+static size_t peak_bytes;
+
+/*
+ * Private module variables: snapshot the table was restored from (base.map is
+ * NULL if none) and how many of its keys have been put again since
+ */
+static struct snapshot base;
+static size_t base_shadowed;
+
+/*
+ * Private module structure: a pair from either layer, for dumping
+ */
+struct pair_ref {
+    const char *key;
+    long value;
+};
+
+/*
+ * Helper function: allocate memory or abort; the table never drops a write
+ * because it ran out of room
+ */
+static void *xrealloc(void *ptr, size_t size)
+{
+    void *result = realloc(ptr, size);
+    if (result == NULL) {
+        fprintf(stderr, "ERROR: local table out of memory (%lu bytes)\n",
+                (unsigned long)size);
+        exit(EXIT_FAILURE);
+    }
+    return result;
+}
+
+/*
+ * Helper function: account for a change in allocated bytes
+ */
+static void track_bytes(size_t added, size_t removed)
+{
+    size_t now = __sync_add_and_fetch(&total_bytes, added - removed);
+    size_t peak = peak_bytes;
+    while (now > peak) {
+        size_t seen = __sync_val_compare_and_swap(&peak_bytes, peak, now);
+        if (seen == peak) {
+            break;
+        }
+        peak = seen;
+    }
+}
+
+/*
+ * Helper function: address of pair i
+ */
+static inline struct kv_pair *pair_at(struct table *t, size_t i)
+{
+    return &t->chunks[i / CHUNK_PAIRS][i % CHUNK_PAIRS];
+}
+
+/*
+ * Helper function: set of processes holding pair i, which is only meaningful
+ * while the pair is shared
+ */
+static uint64_t *sharers_at(struct table *t, size_t i)
+{
+    uint64_t **chunk = &t->sharer_chunks[i / CHUNK_PAIRS];
+    if (*chunk == NULL) {
+        *chunk = xrealloc(NULL, CHUNK_PAIRS * sizeof(uint64_t));
+        t->sharer_chunk_count++;
+        track_bytes(CHUNK_PAIRS * sizeof(uint64_t), 0);
+    }
+    return &(*chunk)[i % CHUNK_PAIRS];
+}
+
+/*
+ * Helper function: FNV-1a hash of a key, also returning its length (at most
+ * MAX_KEYLEN-1). This is deliberately different from the DHT's placement
+ * hash, which picked the keys that are on this rank and so is skewed over
+ * them; under DHT_PLACEMENT=modulo, for one, they all share its value
+ * modulo nprocs, which would cluster the low bits used here.
  */
-static struct kv_pair kv_pairs[MAX_LOCAL_PAIRS];
+static uint32_t key_hash_len(const char *key, size_t *len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < MAX_KEYLEN-1 && key[i] != '\0'; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    *len = i;
+    return h;
+}
+
+static uint32_t key_hash(const char *key)
+{
+    size_t len;
+    return key_hash_len(key, &len);
+}
 
 /*
- * Private module variable: current number of actual key-value pairs
+ * Helper function: the key of a pair, terminated
  */
-static size_t pair_count;
+static inline const char *pair_key(struct table *t, const struct kv_pair *pair)
+{
+    if (pair->keylen < INLINE_KEYLEN) {
+        return pair->key;
+    }
+    uint32_t offset;
+    memcpy(&offset, pair->key, sizeof(offset));
+    return t->key_chunks[offset / KEY_CHUNK_BYTES] + offset % KEY_CHUNK_BYTES + 1;
+}
 
 /*
- * Helper function: search for a key in the local table. Returns the index where
- * the item should be located if it is present (useful for insertions).
+ * Helper function: store the key of a new pair, inline or in the key arena
  */
-size_t find(const char *key)
+static void set_key(struct table *t, struct kv_pair *pair, const char *key, size_t len)
 {
-    if (pair_count == 0) return 0;      // base case
+    pair->keylen = (uint8_t)len;
+    if (len < INLINE_KEYLEN) {
+        memcpy(pair->key, key, len);
+        pair->key[len] = '\0';
+        return;
+    }
 
-    size_t lo = 0;              // lower bound (inclusive)
-    size_t hi = pair_count;     // higher bound (exclusive)
-    while (lo < hi-1) {
-        size_t mid = (lo + hi) / 2;
-        if (strncmp(key, kv_pairs[mid].key, MAX_KEYLEN) < 0) {
-            hi = mid;
-        } else if (strncmp(key, kv_pairs[mid].key, MAX_KEYLEN) > 0) {
-            lo = mid + 1;
-        } else {
-            lo = mid;
+    // length byte, key and terminator; start a new chunk if they do not fit
+    if (t->key_chunk_count == 0 || t->key_used + len + 2 > KEY_CHUNK_BYTES) {
+        if (t->key_chunk_count == t->key_chunk_cap) {
+            size_t new_cap = t->key_chunk_cap == 0 ? 16 : t->key_chunk_cap * 2;
+            t->key_chunks = xrealloc(t->key_chunks, new_cap * sizeof(char *));
+            track_bytes((new_cap - t->key_chunk_cap) * sizeof(char *), 0);
+            t->key_chunk_cap = new_cap;
         }
+        t->key_chunks[t->key_chunk_count++] = xrealloc(NULL, KEY_CHUNK_BYTES);
+        track_bytes(KEY_CHUNK_BYTES, 0);
+        t->key_used = 0;
     }
-    if (lo < pair_count && strncmp(key, kv_pairs[lo].key, MAX_KEYLEN) > 0) {
-        lo++;       // adjust index for insertion if necessary
+    char *dest = t->key_chunks[t->key_chunk_count - 1] + t->key_used;
+    uint32_t offset = (uint32_t)((t->key_chunk_count - 1) * KEY_CHUNK_BYTES + t->key_used);
+    dest[0] = (char)len;
+    memcpy(dest + 1, key, len);
+    dest[len + 1] = '\0';
+    t->key_used += len + 2;
+    memcpy(pair->key, &offset, sizeof(offset));
+}
+
+/*
+ * Helper function: copy a key, truncating it to MAX_KEYLEN-1 characters
+ */
+static void copy_key(char *dest, const char *key)
+{
+    size_t len = 0;
+    while (len < MAX_KEYLEN-1 && key[len] != '\0') {
+        len++;
     }
-    return lo;
+    memcpy(dest, key, len);
+    dest[len] = '\0';
+}
+
+/*
+ * Helper function: search for a key of length len in the hash slots. Returns
+ * the slot that holds the key, or the empty slot where it should be
+ * inserted. Only pairs whose hash and length both match have their key
+ * bytes compared.
+ */
+static size_t find(struct table *t, const char *key, size_t len, uint32_t h)
+{
+    size_t mask = t->slot_count - 1;
+    size_t i = h & mask;
+    while (t->slots[i].index != 0) {
+        if (t->slots[i].hash == h) {
+            struct kv_pair *pair = pair_at(t, t->slots[i].index - 1);
+            if (pair->keylen == len && memcmp(key, pair_key(t, pair), len) == 0) {
+                break;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * Helper function: double the number of hash slots (or create the initial
+ * slots) and reinsert every pair
+ */
+static void grow_slots(struct table *t)
+{
+    size_t old_count = t->slot_count;
+    size_t new_count = old_count == 0 ? MIN_SLOTS : old_count * 2;
+    struct slot *old_slots = t->slots;
+
+    t->slots = calloc(new_count, sizeof(struct slot));
+    if (t->slots == NULL) {
+        fprintf(stderr, "ERROR: local table out of memory (%lu slots)\n",
+                (unsigned long)new_count);
+        exit(EXIT_FAILURE);
+    }
+    t->slot_count = new_count;
+    track_bytes(new_count * sizeof(struct slot), 0);
+
+    // stored hashes make rehashing cheap: no key is touched
+    size_t mask = new_count - 1;
+    for (size_t j = 0; j < old_count; j++) {
+        if (old_slots[j].index != 0) {
+            size_t i = old_slots[j].hash & mask;
+            while (t->slots[i].index != 0) {
+                i = (i + 1) & mask;
+            }
+            t->slots[i] = old_slots[j];
+        }
+    }
+    free(old_slots);
+    track_bytes(0, old_count * sizeof(struct slot));
+}
+
+/*
+ * Helper function: reserve storage for one more pair and return it
+ */
+static struct kv_pair *append_pair(struct table *t)
+{
+    if (t->pair_count == t->chunk_count * CHUNK_PAIRS) {
+        if (t->chunk_count == t->chunk_cap) {
+            size_t new_cap = t->chunk_cap == 0 ? 16 : t->chunk_cap * 2;
+            t->chunks = xrealloc(t->chunks, new_cap * sizeof(struct kv_pair *));
+            t->sharer_chunks = xrealloc(t->sharer_chunks, new_cap * sizeof(uint64_t *));
+            for (size_t c = t->chunk_cap; c < new_cap; c++) {
+                t->sharer_chunks[c] = NULL;
+            }
+            track_bytes((new_cap - t->chunk_cap) * (sizeof(struct kv_pair *) + sizeof(uint64_t *)), 0);
+            t->chunk_cap = new_cap;
+        }
+        t->chunks[t->chunk_count++] =
+            xrealloc(NULL, CHUNK_PAIRS * sizeof(struct kv_pair));
+        track_bytes(CHUNK_PAIRS * sizeof(struct kv_pair), 0);
+    }
+    return pair_at(t, t->pair_count++);
+}
+
+/*
+ * Helper function: shard that holds a key with hash h
+ */
+static inline struct table *shard_for(uint32_t h)
+{
+    return &tables[h >> (32 - SHARD_BITS)];
+}
+
+/*
+ * Helper function: release all storage held by a shard
+ */
+static void release(struct table *t)
+{
+    for (size_t c = 0; c < t->chunk_count; c++) {
+        free(t->chunks[c]);
+        free(t->sharer_chunks[c]);
+    }
+    free(t->chunks);
+    free(t->sharer_chunks);
+    for (size_t c = 0; c < t->key_chunk_count; c++) {
+        free(t->key_chunks[c]);
+    }
+    free(t->key_chunks);
+    free(t->slots);
+    track_bytes(0, t->chunk_count * CHUNK_PAIRS * sizeof(struct kv_pair)
+            + t->chunk_cap * (sizeof(struct kv_pair *) + sizeof(uint64_t *))
+            + t->sharer_chunk_count * CHUNK_PAIRS * sizeof(uint64_t)
+            + t->key_chunk_count * KEY_CHUNK_BYTES
+            + t->key_chunk_cap * sizeof(char *)
+            + t->slot_count * sizeof(struct slot));
+    t->chunks = NULL;
+    t->chunk_count = 0;
+    t->chunk_cap = 0;
+    t->sharer_chunks = NULL;
+    t->sharer_chunk_count = 0;
+    t->key_chunks = NULL;
+    t->key_chunk_count = 0;
+    t->key_chunk_cap = 0;
+    t->key_used = 0;
+    t->slots = NULL;
+    t->slot_count = 0;
+    t->pair_count = 0;
+    t->last_version = 0;
+}
+
+/*
+ * Helper function: ordering for qsort when dumping the table
+ */
+static int compare_pairs(const void *a, const void *b)
+{
+    return strncmp(((const struct pair_ref *)a)->key,
+                   ((const struct pair_ref *)b)->key, MAX_KEYLEN);
+}
+
+/*
+ * Helper function: pair stored for a key in the snapshot layer, or NULL
+ */
+static const struct snapshot_pair *base_find(const char *key, uint32_t h)
+{
+    if (base.map == NULL) {
+        return NULL;
+    }
+    return snapshot_find(&base, key, h);
+}
+
+/*
+ * Helper function: add a new pair for a key whose slot i is empty
+ */
+static struct kv_pair *insert_pair(struct table *t, const char *key, size_t len,
+        uint32_t h, size_t i)
+{
+    struct kv_pair *pair = append_pair(t);
+    set_key(t, pair, key, len);
+    t->slots[i].hash = h;
+    t->slots[i].index = (uint32_t)t->pair_count;
+    if (base_find(key, h) != NULL) {
+        __sync_add_and_fetch(&base_shadowed, 1);
+    }
+    return pair;
+}
+
+/*
+ * Helper function: every pair of both layers that matches scan (all of them
+ * if it is NULL), sorted by key; all shards must be locked
+ */
+static struct pair_ref *collect_pairs(const struct local_scan *scan, size_t *count)
+{
+    size_t n = 0;
+    size_t max = base.map != NULL ? base.header->pair_count : 0;
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        max += tables[s].pair_count;
+    }
+    struct pair_ref *refs = xrealloc(NULL, (max + 1) * sizeof(struct pair_ref));
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        for (size_t i = 0; i < tables[s].pair_count; i++) {
+            struct kv_pair *pair = pair_at(&tables[s], i);
+            refs[n].key = pair_key(&tables[s], pair);
+            refs[n].value = pair->value;
+            if (scan == NULL || local_scan_match(scan, refs[n].key)) {
+                n++;
+            }
+        }
+    }
+
+    // snapshot pairs that have not been put again
+    for (size_t p = 0; base.map != NULL && p < base.header->pair_count; p++) {
+        const struct snapshot_pair *pair = &base.pairs[p];
+        size_t len;
+        uint32_t h = key_hash_len(pair->key, &len);
+        struct table *t = shard_for(h);
+        if (t->pair_count > 0 && t->slots[find(t, pair->key, len, h)].index != 0) {
+            continue;
+        }
+        if (scan != NULL && !local_scan_match(scan, pair->key)) {
+            continue;
+        }
+        refs[n].key = pair->key;
+        refs[n].value = (long)pair->value;
+        n++;
+    }
+
+    qsort(refs, n, sizeof(struct pair_ref), compare_pairs);
+    *count = n;
+    return refs;
 }
 
 /*
@@ -64,62 +488,418 @@ size_t find(const char *key)
 
 void local_init()
 {
-    // initialize file storage
-    memset(kv_pairs, 0, sizeof(struct kv_pair) * MAX_LOCAL_PAIRS);
-    pair_count = 0;
+    // storage is allocated lazily by the first insert
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        if (!tables_initialized) {
+            pthread_mutex_init(&tables[s].lock, NULL);
+        }
+        release(&tables[s]);
+    }
+    tables_initialized = true;
+    total_bytes = 0;
+    peak_bytes = 0;
+    snapshot_close(&base);
+    base_shadowed = 0;
+}
+
+void local_load(const char *path, unsigned rank, unsigned nprocs, unsigned placement)
+{
+    if (!snapshot_open(path, &base, false)) {
+        exit(EXIT_FAILURE);
+    }
+    if (base.header->rank != rank || base.header->nprocs != nprocs) {
+        fprintf(stderr, "ERROR: snapshot \"%s\" belongs to process %u of %u\n",
+                path, base.header->rank, base.header->nprocs);
+        exit(EXIT_FAILURE);
+    }
+    if (base.header->placement != placement) {
+        fprintf(stderr, "ERROR: snapshot \"%s\" was written with another key placement\n",
+                path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool local_scan_match(const struct local_scan *scan, const char *key)
+{
+    if (scan->lo != NULL && strncmp(key, scan->lo, MAX_KEYLEN-1) < 0) {
+        return false;
+    }
+    if (scan->hi != NULL && strncmp(key, scan->hi, MAX_KEYLEN-1) >= 0) {
+        return false;
+    }
+    if (scan->prefix == NULL) {
+        return true;
+    }
+    size_t len = strlen(scan->prefix);
+    return strncmp(key, scan->prefix, len < MAX_KEYLEN-1 ? len : MAX_KEYLEN-1) == 0;
+}
+
+struct snapshot_pair *local_pairs(size_t *count)
+{
+    return local_scan(NULL, count);
+}
+
+struct snapshot_pair *local_scan(const struct local_scan *scan, size_t *count)
+{
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        pthread_mutex_lock(&tables[s].lock);
+    }
+    struct pair_ref *refs = collect_pairs(scan, count);
+    struct snapshot_pair *pairs = xrealloc(NULL, (*count + 1) * sizeof(struct snapshot_pair));
+    for (size_t i = 0; i < *count; i++) {
+        memset(pairs[i].key, 0, MAX_KEYLEN);
+        copy_key(pairs[i].key, refs[i].key);
+        pairs[i].value = refs[i].value;
+    }
+    free(refs);
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        pthread_mutex_unlock(&tables[s].lock);
+    }
+    return pairs;
+}
+
+bool local_save(const char *path, unsigned rank, unsigned nprocs, unsigned placement)
+{
+    size_t count;
+    struct snapshot_pair *pairs = local_pairs(&count);
+    bool ok = snapshot_write(path, pairs, count, rank, nprocs, placement);
+    free(pairs);
+    return ok;
+}
+
+int local_shard(const char *key)
+{
+    return (int)(key_hash(key) >> (32 - SHARD_BITS));
 }
 
 void local_put(const char *key, long value)
 {
-    int idx = find(key);
-    if (idx < MAX_LOCAL_PAIRS &&
-            strncmp(key, kv_pairs[idx].key, MAX_LOCAL_PAIRS) == 0) {
+    unsigned long version;
+    local_put_version(key, value, &version);
+}
+
+uint64_t local_put_version(const char *key, long value, unsigned long *version)
+{
+    size_t len;
+    uint32_t h = key_hash_len(key, &len);
+    struct table *t = shard_for(h);
+    uint64_t sharers = 0;
+    pthread_mutex_lock(&t->lock);
+
+    // keep the load factor at or below one half
+    if (2 * (t->pair_count + 1) > t->slot_count) {
+        grow_slots(t);
+    }
+
+    size_t i = find(t, key, len, h);
+    if (t->slots[i].index != 0) {
 
         // found an existing key; just change the associated value
-        kv_pairs[idx].value = value;
+        struct kv_pair *pair = pair_at(t, t->slots[i].index - 1);
+        pair->value = value;
+        pair->version = ++t->last_version;
+        if (pair->shared) {
+            sharers = *sharers_at(t, t->slots[i].index - 1);
+        }
+        pair->shared = false;
+        *version = pair->version;
 
     } else {
 
-        // check to see if we have space for a new key-value pair
-        if (pair_count >= MAX_LOCAL_PAIRS) {
-            return;
+        // append the new key-value pair and point the empty slot at it
+        struct kv_pair *pair = insert_pair(t, key, len, h, i);
+        pair->value = value;
+        pair->version = ++t->last_version;
+        pair->shared = false;
+        *version = pair->version;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return sharers;
+}
+
+void local_put_bulk(const struct snapshot_pair *pairs, size_t count)
+{
+    // hash every key once and order the pairs by shard, keeping their order
+    // within each shard
+    uint32_t *hashes = xrealloc(NULL, (count + 1) * sizeof(uint32_t));
+    uint8_t *lens = xrealloc(NULL, count + 1);
+    size_t *order = xrealloc(NULL, (count + 1) * sizeof(size_t));
+    size_t start[LOCAL_SHARDS + 1];
+    memset(start, 0, sizeof(start));
+    for (size_t j = 0; j < count; j++) {
+        size_t len;
+        hashes[j] = key_hash_len(pairs[j].key, &len);
+        lens[j] = (uint8_t)len;
+        start[(hashes[j] >> (32 - SHARD_BITS)) + 1]++;
+    }
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        start[s + 1] += start[s];
+    }
+    size_t fill[LOCAL_SHARDS];
+    memcpy(fill, start, sizeof(fill));
+    for (size_t j = 0; j < count; j++) {
+        order[fill[hashes[j] >> (32 - SHARD_BITS)]++] = j;
+    }
+
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        if (start[s] == start[s + 1]) {
+            continue;
         }
+        struct table *t = &tables[s];
+        pthread_mutex_lock(&t->lock);
+
+        // size the slots for all of them up front
+        while (2 * (t->pair_count + start[s + 1] - start[s]) > t->slot_count) {
+            grow_slots(t);
+        }
+        for (size_t o = start[s]; o < start[s + 1]; o++) {
+            const struct snapshot_pair *p = &pairs[order[o]];
+            uint32_t h = hashes[order[o]];
+            size_t len = lens[order[o]];
+            size_t i = find(t, p->key, len, h);
+            struct kv_pair *pair = t->slots[i].index != 0 ?
+                pair_at(t, t->slots[i].index - 1) : insert_pair(t, p->key, len, h, i);
+            pair->value = (long)p->value;
+            pair->version = ++t->last_version;
+            pair->shared = false;
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+    free(order);
+    free(lens);
+    free(hashes);
+}
+
+bool local_take(const char *key, long *value)
+{
+    size_t len;
+    uint32_t h = key_hash_len(key, &len);
+    struct table *t = shard_for(h);
+    pthread_mutex_lock(&t->lock);
+    size_t i = t->pair_count > 0 ? find(t, key, len, h) : 0;
+    if (t->pair_count == 0 || t->slots[i].index == 0 || base_find(key, h) != NULL) {
+        pthread_mutex_unlock(&t->lock);
+        return false;
+    }
+    size_t removed = t->slots[i].index - 1;
+    *value = pair_at(t, removed)->value;
 
-        // shift subsequent pairs
-        for (size_t i = pair_count; i > idx; i--) {
-            memcpy((void*)&kv_pairs[i], (void*)&kv_pairs[i-1], sizeof(struct kv_pair));
+    // empty the slot, then pull back any later slot of the probe run that
+    // can no longer be reached past the hole (so no tombstones are needed)
+    size_t mask = t->slot_count - 1;
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (t->slots[j].index == 0) {
+            break;
+        }
+        size_t home = t->slots[j].hash & mask;
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            t->slots[i] = t->slots[j];
+            i = j;
         }
+    }
+    t->slots[i].index = 0;
 
-        // insert the new key-value pair into the table
-        snprintf((char*)&kv_pairs[idx].key, MAX_KEYLEN, "%s", key);
-        kv_pairs[idx].value = value;
-        pair_count++;
+    // keep the pairs dense: the last pair moves into the gap
+    size_t last = t->pair_count - 1;
+    if (removed != last) {
+        struct kv_pair *moved = pair_at(t, last);
+        size_t moved_len;
+        uint32_t moved_hash = key_hash_len(pair_key(t, moved), &moved_len);
+        size_t k = moved_hash & mask;
+        while (t->slots[k].index != last + 1) {
+            k = (k + 1) & mask;
+        }
+        t->slots[k].index = (uint32_t)(removed + 1);
+        *pair_at(t, removed) = *moved;
+        if (moved->shared) {
+            *sharers_at(t, removed) = *sharers_at(t, last);
+        }
     }
+    t->pair_count--;
+    pthread_mutex_unlock(&t->lock);
+    return true;
 }
 
 long local_get(const char *key)
 {
-    size_t idx = find(key);
-    if (strncmp(key, kv_pairs[idx].key, MAX_KEYLEN) == 0) {
-        return kv_pairs[idx].value;
+    unsigned long version;
+    return local_get_version(key, &version, 0);
+}
+
+long local_get_version(const char *key, unsigned long *version, uint64_t share)
+{
+    size_t len;
+    uint32_t h = key_hash_len(key, &len);
+    struct table *t = shard_for(h);
+    long value = KEY_NOT_FOUND;
+    *version = 0;
+
+    pthread_mutex_lock(&t->lock);
+    struct kv_pair *pair = NULL;
+    size_t index = 0;
+    if (t->pair_count > 0) {
+        size_t i = find(t, key, len, h);
+        if (t->slots[i].index != 0) {
+            index = t->slots[i].index - 1;
+            pair = pair_at(t, index);
+        }
+    }
+    const struct snapshot_pair *saved = pair == NULL ? base_find(key, h) : NULL;
+    if (saved != NULL && share != 0) {
+
+        // a snapshot value handed out to a cache needs a version and a
+        // shared flag, so it is copied into the shards first
+        if (2 * (t->pair_count + 1) > t->slot_count) {
+            grow_slots(t);
+        }
+        pair = insert_pair(t, key, len, h, find(t, key, len, h));
+        index = t->pair_count - 1;
+        pair->value = (long)saved->value;
+        pair->version = ++t->last_version;
+        pair->shared = false;
+    }
+    if (pair != NULL) {
+        value = pair->value;
+        *version = pair->version;
+        if (share != 0) {
+            uint64_t *sharers = sharers_at(t, index);
+            *sharers = pair->shared ? *sharers | share : share;
+            pair->shared = true;
+        }
+    } else if (saved != NULL) {
+        value = (long)saved->value;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return value;
+}
+
+long local_update(const char *key, int op, long operand, long expected,
+        unsigned long *version, uint64_t *sharers)
+{
+    size_t len;
+    uint32_t h = key_hash_len(key, &len);
+    struct table *t = shard_for(h);
+    *version = 0;
+    *sharers = 0;
+    pthread_mutex_lock(&t->lock);
+
+    // current value, from the shards or else the snapshot layer
+    struct kv_pair *pair = NULL;
+    size_t index = 0;
+    bool found = false;
+    long old = KEY_NOT_FOUND;
+    if (t->pair_count > 0) {
+        size_t i = find(t, key, len, h);
+        if (t->slots[i].index != 0) {
+            index = t->slots[i].index - 1;
+            pair = pair_at(t, index);
+            old = pair->value;
+            found = true;
+        }
+    }
+    if (!found) {
+        const struct snapshot_pair *saved = base_find(key, h);
+        if (saved != NULL) {
+            old = (long)saved->value;
+            found = true;
+        }
+    }
+
+    long value;
+    long result = old;
+    bool store;
+    switch (op) {
+        case LOCAL_ADD:
+            value = (found ? old : 0) + operand;
+            result = value;
+            store = true;
+            break;
+        case LOCAL_CAS:
+            value = operand;
+            store = found ? old == expected : expected == KEY_NOT_FOUND;
+            break;
+        case LOCAL_MAX:
+            value = operand;
+            store = !found || operand > old;
+            break;
+        default:
+            value = 0;
+            store = false;
+            break;
+    }
+
+    if (store) {
+        if (pair == NULL) {
+
+            // new to the shards (possibly shadowing the snapshot)
+            if (2 * (t->pair_count + 1) > t->slot_count) {
+                grow_slots(t);
+            }
+            pair = insert_pair(t, key, len, h, find(t, key, len, h));
+            pair->shared = false;
+        }
+        pair->value = value;
+        pair->version = ++t->last_version;
+        if (pair->shared) {
+            *sharers = *sharers_at(t, index);
+        }
+        pair->shared = false;
+        *version = pair->version;
     }
-    return KEY_NOT_FOUND;
+    pthread_mutex_unlock(&t->lock);
+    return result;
 }
 
 size_t local_size()
 {
-    return pair_count;
+    size_t size = 0;
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        pthread_mutex_lock(&tables[s].lock);
+        size += tables[s].pair_count;
+        pthread_mutex_unlock(&tables[s].lock);
+    }
+    if (base.map != NULL) {
+        size += base.header->pair_count - base_shadowed;
+    }
+    return size;
+}
+
+size_t local_bytes()
+{
+    return total_bytes;
+}
+
+size_t local_peak_bytes()
+{
+    return peak_bytes;
 }
 
 void local_destroy(FILE *output)
 {
-    // print all pairs to output
-    for (size_t i = 0; i < pair_count; i++) {
-        fprintf(output, "  Key=\"%s\" Value=%ld\n",
-                kv_pairs[i].key, kv_pairs[i].value);
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        pthread_mutex_lock(&tables[s].lock);
     }
 
-    // reset pair count
-    pair_count = 0;
-}
+    // sort once so the dump is ordered lexicographically by key
+    if (output != NULL) {
+        size_t count;
+        struct pair_ref *sorted = collect_pairs(NULL, &count);
 
+        // print all pairs to output
+        for (size_t i = 0; i < count; i++) {
+            fprintf(output, "  Key=\"%s\" Value=%ld\n",
+                    sorted[i].key, sorted[i].value);
+        }
+        free(sorted);
+    }
+
+    // free storage and reset pair counts
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        release(&tables[s]);
+        pthread_mutex_unlock(&tables[s].lock);
+    }
+    snapshot_close(&base);
+    base_shadowed = 0;
+}
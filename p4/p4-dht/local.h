@@ -3,15 +3,17 @@
  *
  * CS 470 Project 4
  *
- * Private private interface for local hash table.
- *
- * DO NOT CHANGE THIS FILE!
+ * Private interface for the local key-value table that holds each process's
+ * part of the DHT: a sharded, thread-safe hash table with versioned access
+ * for caching, atomic updates, snapshots, bulk loads and ordered scans (see
+ * local.c).
  */
 
 #ifndef __LOCAL_H
 #define __LOCAL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,14 +22,106 @@
 
 #define KEY_NOT_FOUND -1
 
+// Number of independently locked shards in the local table; all functions
+// below are safe to call from several threads at once
+#define LOCAL_SHARDS 16
+
 /*
  * Local hash table function prototypes
  */
 void   local_init();
+int    local_shard(const char *key);    // shard (0..LOCAL_SHARDS-1) of a key
 void   local_put(const char *key, long value);
 long   local_get(const char *key);
 size_t local_size();
-void   local_destroy(FILE *out);
+
+/*
+ * Versioned access for client-side caching. Each put stamps the pair with a
+ * new version (increasing per key). local_get_version() returns the version
+ * along with the value (zero if the key is missing) and adds the processes
+ * in share, a set of LOCAL_SHARER bits, to those the pair is cached by;
+ * local_put_version() returns that set as it was before this put (and
+ * empties it).
+ */
+long     local_get_version(const char *key, unsigned long *version, uint64_t share);
+uint64_t local_put_version(const char *key, long value, unsigned long *version);
+
+/*
+ * Bit of process p in a set of sharers. Processes 64 apart share a bit, so a
+ * set may name more processes than actually cache the pair, never fewer.
+ */
+#define LOCAL_SHARER(p) ((uint64_t)1 << ((p) % 64))
+
+/*
+ * Atomic read-modify-write of one pair (under its shard's lock):
+ *
+ *   LOCAL_ADD  value += operand, a missing key counting as zero; returns the
+ *              new value
+ *   LOCAL_CAS  value = operand if the current value equals expected (which
+ *              may be KEY_NOT_FOUND to create a missing key); returns the
+ *              value before the call
+ *   LOCAL_MAX  value = operand if the key is missing or operand is larger;
+ *              returns the value before the call
+ *
+ * *version is the version stamped on the pair, or zero if nothing was
+ * stored; *sharers is set as local_put_version() returns it.
+ */
+#define LOCAL_ADD 1
+#define LOCAL_CAS 2
+#define LOCAL_MAX 3
+
+long   local_update(const char *key, int op, long operand, long expected,
+                    unsigned long *version, uint64_t *sharers);
+
+/*
+ * Binary snapshots (see snapshot.h). local_save() writes every pair to a
+ * snapshot file and returns false if it could not. local_load() maps a
+ * snapshot into a freshly initialized table without copying it; its pairs
+ * can be read and overwritten like any other. It exits if the snapshot is
+ * unusable or was written by another process or key placement.
+ */
+bool   local_save(const char *path, unsigned rank, unsigned nprocs, unsigned placement);
+void   local_load(const char *path, unsigned rank, unsigned nprocs, unsigned placement);
+
+struct snapshot_pair;
+
+/*
+ * Store many pairs at once (later pairs win over earlier ones with the same
+ * key). Each shard is locked and grown only once, so this is much faster
+ * than a local_put per pair.
+ */
+void   local_put_bulk(const struct snapshot_pair *pairs, size_t count);
+
+/*
+ * Remove a pair, returning whether it was there and its value. Keys of a
+ * restored snapshot cannot be removed (false is returned).
+ */
+bool   local_take(const char *key, long *value);
+
+/*
+ * Copy of every pair, sorted by key and laid out as in a snapshot (free it
+ * when done)
+ */
+struct snapshot_pair *local_pairs(size_t *count);
+
+/*
+ * Key scans. A key matches a scan if lo <= key < hi (in the byte order of
+ * the dump; a NULL bound is open) and it starts with prefix (NULL matches
+ * every key). local_scan() returns a copy of the matching pairs, sorted by
+ * key and laid out as in a snapshot (free it when done).
+ */
+struct local_scan {
+    const char *lo;
+    const char *hi;
+    const char *prefix;
+};
+
+bool   local_scan_match(const struct local_scan *scan, const char *key);
+struct snapshot_pair *local_scan(const struct local_scan *scan, size_t *count);
+
+size_t local_bytes();         // bytes currently allocated by the table
+size_t local_peak_bytes();    // high-water mark of local_bytes()
+void   local_destroy(FILE *out);    // out may be NULL to skip the dump
 
 #endif
 
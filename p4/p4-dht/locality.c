@@ -0,0 +1,262 @@
+/**
+ * locality.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of access tracking and the key directory (see locality.h).
+ * Tracked keys live in LOCAL_SHARDS independently locked stripes of slots;
+ * a key may sit in any of the TRACK_PROBES slots from its hash. The
+ * directory is an open-addressing hash table (linear probing) that doubles
+ * whenever its load factor would pass one half.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "locality.h"
+#include "ring.h"
+
+/*
+ * Slots a tracked key may occupy, starting at its hash
+ */
+#define TRACK_PROBES 8
+
+/*
+ * Initial number of directory slots; must be a power of two
+ */
+#define MIN_DIRECTORY_SLOTS 64
+
+/*
+ * Private module structure: one tracked key (free if votes is zero)
+ */
+struct tracked {
+    char key[MAX_KEYLEN];
+    uint32_t hash;
+    int candidate;
+    unsigned votes;
+};
+
+/*
+ * Private module structure: one stripe of tracked keys
+ */
+struct stripe {
+    struct tracked *slots;
+    size_t slot_count;          // power of two
+    pthread_mutex_t lock;
+};
+
+/*
+ * Private module structure: one directory entry (free if owner is negative)
+ */
+struct entry {
+    char key[MAX_KEYLEN];
+    int owner;
+};
+
+static struct stripe stripes[LOCAL_SHARDS];
+static bool tracking;
+static struct entry *directory;
+static size_t directory_slots;
+static size_t directory_count;
+
+/*
+ * Helper function: hash of a key (the low bits pick a slot, the high bits a
+ * stripe)
+ */
+static uint32_t key_hash(const char *key)
+{
+    return ring_hash_fnv1a(key);
+}
+
+/*
+ * Helper function: directory slot that holds a key, or the free slot where
+ * it belongs
+ */
+static size_t find(const char *key)
+{
+    size_t mask = directory_slots - 1;
+    size_t i = key_hash(key) & mask;
+    while (directory[i].owner >= 0 && strncmp(directory[i].key, key, MAX_KEYLEN-1) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * Helper function: double the directory slots (or create the first ones)
+ * and reinsert every entry
+ */
+static void grow_directory()
+{
+    struct entry *old = directory;
+    size_t old_slots = directory_slots;
+    directory_slots = old_slots == 0 ? MIN_DIRECTORY_SLOTS : old_slots * 2;
+    directory = malloc(directory_slots * sizeof(struct entry));
+    for (size_t i = 0; i < directory_slots; i++) {
+        directory[i].owner = -1;
+    }
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].owner >= 0) {
+            directory[find(old[i].key)] = old[i];
+        }
+    }
+    free(old);
+}
+
+void locality_init(size_t tracked)
+{
+    locality_destroy();
+    tracking = tracked > 0;
+    if (!tracking) {
+        return;
+    }
+    size_t per_stripe = TRACK_PROBES;
+    while (per_stripe * LOCAL_SHARDS < tracked) {
+        per_stripe *= 2;
+    }
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        stripes[s].slots = calloc(per_stripe, sizeof(struct tracked));
+        stripes[s].slot_count = per_stripe;
+        pthread_mutex_init(&stripes[s].lock, NULL);
+    }
+}
+
+void locality_record(const char *key, int accessor)
+{
+    if (!tracking) {
+        return;
+    }
+    uint32_t h = key_hash(key);
+    struct stripe *s = &stripes[(h >> 16) % LOCAL_SHARDS];
+    size_t mask = s->slot_count - 1;
+    pthread_mutex_lock(&s->lock);
+
+    // the key's slot, or else a free one, or else the weakest
+    struct tracked *match = NULL;
+    struct tracked *weakest = NULL;
+    for (size_t p = 0; p < TRACK_PROBES && match == NULL; p++) {
+        struct tracked *t = &s->slots[(h + p) & mask];
+        if (t->votes > 0 && t->hash == h && strncmp(t->key, key, MAX_KEYLEN-1) == 0) {
+            match = t;
+        } else if (weakest == NULL || t->votes < weakest->votes) {
+            weakest = t;
+        }
+    }
+
+    if (match != NULL) {
+        if (match->candidate == accessor) {
+            match->votes++;
+        } else {
+            match->votes--;
+        }
+    } else if (weakest->votes > 0) {
+        // every slot is taken: the weakest key loses a vote instead, and
+        // is only replaced once it has none left
+        weakest->votes--;
+    } else {
+        snprintf(weakest->key, MAX_KEYLEN, "%s", key);
+        weakest->hash = h;
+        weakest->candidate = accessor;
+        weakest->votes = 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+struct locality_move *locality_moves(int self, unsigned threshold, size_t *count)
+{
+    size_t n = 0;
+    size_t cap = 16;
+    struct locality_move *moves = malloc(cap * sizeof(struct locality_move));
+    for (int st = 0; tracking && st < LOCAL_SHARDS; st++) {
+        struct stripe *s = &stripes[st];
+        pthread_mutex_lock(&s->lock);
+        for (size_t i = 0; i < s->slot_count; i++) {
+            struct tracked *t = &s->slots[i];
+            if (t->votes >= threshold && t->votes > 0 && t->candidate != self) {
+                if (n == cap) {
+                    cap *= 2;
+                    moves = realloc(moves, cap * sizeof(struct locality_move));
+                }
+                memcpy(moves[n].key, t->key, MAX_KEYLEN);
+                moves[n].owner = t->candidate;
+                n++;
+            }
+            t->votes = 0;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    *count = n;
+    return moves;
+}
+
+int locality_owner(const char *key)
+{
+    if (directory_count == 0) {
+        return -1;
+    }
+    return directory[find(key)].owner;
+}
+
+void locality_set_owner(const char *key, int owner)
+{
+    if (owner >= 0) {
+        if (2 * (directory_count + 1) > directory_slots) {
+            grow_directory();
+        }
+        size_t i = find(key);
+        if (directory[i].owner < 0) {
+            snprintf(directory[i].key, MAX_KEYLEN, "%s", key);
+            directory_count++;
+        }
+        directory[i].owner = owner;
+        return;
+    }
+
+    if (directory_count == 0) {
+        return;
+    }
+    size_t i = find(key);
+    if (directory[i].owner < 0) {
+        return;
+    }
+
+    // empty the slot, then pull back any later entry of the probe run that
+    // can no longer be reached past the hole
+    size_t mask = directory_slots - 1;
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (directory[j].owner < 0) {
+            break;
+        }
+        size_t home = key_hash(directory[j].key) & mask;
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            directory[i] = directory[j];
+            i = j;
+        }
+    }
+    directory[i].owner = -1;
+    directory_count--;
+}
+
+size_t locality_directory_size()
+{
+    return directory_count;
+}
+
+void locality_destroy()
+{
+    for (int s = 0; s < LOCAL_SHARDS; s++) {
+        if (stripes[s].slots != NULL) {
+            pthread_mutex_destroy(&stripes[s].lock);
+        }
+        free(stripes[s].slots);
+        stripes[s].slots = NULL;
+        stripes[s].slot_count = 0;
+    }
+    tracking = false;
+    free(directory);
+    directory = NULL;
+    directory_slots = 0;
+    directory_count = 0;
+}
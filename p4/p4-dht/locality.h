@@ -0,0 +1,65 @@
+/**
+ * locality.h
+ *
+ * CS 470 Project 4
+ *
+ * Locality-aware key placement. An owner tracks which process accesses each
+ * of its keys most, with a majority vote per key: an access by the current
+ * candidate adds a vote, any other takes one away, and a key whose votes run
+ * out gets the next accessor as its candidate. A candidate that leads by
+ * many votes is the key's dominant accessor, and the key can move there.
+ * Only a fixed number of keys is tracked; a new key wears down the weakest
+ * key near its slot and takes its place once that one has no votes left.
+ *
+ * Keys that have moved away from the process that placement gives them are
+ * listed in a directory of their current owners. Every process keeps the
+ * same directory, which only changes while no other thread is in a DHT call
+ * (at dht_sync), so lookups need no lock and are never stale. Tracking is
+ * safe to call from several threads at once.
+ */
+
+#ifndef __LOCALITY_H
+#define __LOCALITY_H
+
+#include "local.h"
+
+/*
+ * A key to move, and the process to move it to
+ */
+struct locality_move {
+    char key[MAX_KEYLEN];
+    int owner;
+};
+
+/*
+ * Track up to about tracked keys; zero disables tracking
+ */
+void locality_init(size_t tracked);
+
+/*
+ * Count one access to a key by a process
+ */
+void locality_record(const char *key, int accessor);
+
+/*
+ * Keys whose candidate is not self and leads by at least threshold votes
+ * (free the array when done). Tracking starts over afterwards.
+ */
+struct locality_move *locality_moves(int self, unsigned threshold, size_t *count);
+
+/*
+ * Current owner of a key in the directory, or -1 if it has not moved
+ */
+int locality_owner(const char *key);
+
+/*
+ * Record that a key now lives on owner; a negative owner removes the key
+ * from the directory (it is back where placement puts it)
+ */
+void locality_set_owner(const char *key, int owner);
+
+size_t locality_directory_size();
+
+void locality_destroy();
+
+#endif
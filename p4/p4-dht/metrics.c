@@ -0,0 +1,146 @@
+/**
+ * metrics.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the DHT instrumentation counters (see metrics.h).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "metrics.h"
+
+/*
+ * Private module variable: the counters of this process
+ */
+static unsigned long counters[METRICS_COUNT];
+
+/*
+ * Private module variable: counter names in the report, in counter order
+ */
+static const char *names[METRICS_COUNT] = {
+    "put", "get", "get_many_keys", "update", "size", "sync", "bulk_load_pairs",
+    "scan_pairs", "client_messages", "client_bytes_sent",
+    "client_bytes_received", "reply_wait_ns", "reply_waits",
+    "confirm_wait_ns", "confirm_waits", "served_put", "served_get",
+    "served_get_many", "served_update", "served_size", "served_scan",
+    "served_invalidate", "served_replicate", "served_confirm",
+    "server_bytes_received", "server_bytes_sent", "service_ns",
+    "service_max_ns", "queue_depth", "queue_depth_max", "local_ops",
+    "migrated_out", "migrated_in",
+};
+
+/*
+ * Helper function: is a counter a maximum rather than a sum?
+ */
+static bool is_max(int metric)
+{
+    return metric == METRIC_SERVICE_MAX_NS || metric == METRIC_QUEUE_DEPTH_MAX;
+}
+
+/*
+ * Helper function: mean of a total over a count (zero if there is none)
+ */
+static double mean(unsigned long total, unsigned long count)
+{
+    return count == 0 ? 0.0 : (double)total / count;
+}
+
+/*
+ * Helper function: write one set of counters as a JSON object (with the
+ * rank it belongs to, unless rank is negative)
+ */
+static void write_object(FILE *out, const unsigned long *v, int rank, const char *indent)
+{
+    fprintf(out, "{\n");
+    if (rank >= 0) {
+        fprintf(out, "%s  \"rank\": %d,\n", indent, rank);
+    }
+    for (int m = 0; m < METRICS_COUNT; m++) {
+        fprintf(out, "%s  \"%s\": %lu,\n", indent, names[m], v[m]);
+    }
+    unsigned long served = 0;
+    for (int m = METRIC_SERVED_PUT; m <= METRIC_SERVED_CONFIRM; m++) {
+        served += v[m];
+    }
+    fprintf(out, "%s  \"mean_reply_wait_us\": %.3f,\n", indent,
+            mean(v[METRIC_REPLY_WAIT_NS], v[METRIC_REPLY_WAITS]) / 1e3);
+    fprintf(out, "%s  \"mean_confirm_wait_us\": %.3f,\n", indent,
+            mean(v[METRIC_CONFIRM_WAIT_NS], v[METRIC_CONFIRM_WAITS]) / 1e3);
+    fprintf(out, "%s  \"mean_service_us\": %.3f,\n", indent,
+            mean(v[METRIC_SERVICE_NS], served) / 1e3);
+    fprintf(out, "%s  \"mean_queue_depth\": %.3f,\n", indent,
+            mean(v[METRIC_QUEUE_DEPTH], served));
+    unsigned long ops = v[METRIC_PUT] + v[METRIC_GET] + v[METRIC_GET_MANY] + v[METRIC_UPDATE];
+    fprintf(out, "%s  \"local_op_fraction\": %.4f,\n", indent,
+            mean(v[METRIC_LOCAL_OPS], ops));
+    fprintf(out, "%s  \"migrated_per_sync\": %.3f\n", indent,
+            mean(v[METRIC_MIGRATED_OUT], v[METRIC_SYNC]));
+    fprintf(out, "%s}", indent);
+}
+
+void metrics_init()
+{
+    memset(counters, 0, sizeof(counters));
+}
+
+void metrics_add(int metric, unsigned long amount)
+{
+    __sync_add_and_fetch(&counters[metric], amount);
+}
+
+void metrics_max(int metric, unsigned long value)
+{
+    unsigned long seen = counters[metric];
+    while (value > seen) {
+        unsigned long prev = __sync_val_compare_and_swap(&counters[metric], seen, value);
+        if (prev == seen) {
+            break;
+        }
+        seen = prev;
+    }
+}
+
+unsigned long metrics_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000000ul + (unsigned long)now.tv_nsec;
+}
+
+void metrics_get(unsigned long *values)
+{
+    for (int m = 0; m < METRICS_COUNT; m++) {
+        values[m] = __sync_add_and_fetch(&counters[m], 0);
+    }
+}
+
+bool metrics_write(const char *path, const unsigned long *values, int nprocs)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return false;
+    }
+
+    unsigned long total[METRICS_COUNT];
+    memset(total, 0, sizeof(total));
+    for (int p = 0; p < nprocs; p++) {
+        for (int m = 0; m < METRICS_COUNT; m++) {
+            unsigned long v = values[p * METRICS_COUNT + m];
+            total[m] = is_max(m) ? (v > total[m] ? v : total[m]) : total[m] + v;
+        }
+    }
+
+    fprintf(out, "{\n  \"procs\": %d,\n  \"ranks\": [\n", nprocs);
+    for (int p = 0; p < nprocs; p++) {
+        fprintf(out, "    ");
+        write_object(out, values + p * METRICS_COUNT, p, "    ");
+        fprintf(out, "%s\n", p < nprocs - 1 ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"total\": ");
+    write_object(out, total, -1, "  ");
+    fprintf(out, "\n}\n");
+    return fclose(out) == 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * metrics.h
+ *
+ * CS 470 Project 4
+ *
+ * Per-process instrumentation counters for the DHT: client operations by
+ * type, messages and bytes on both sides, time clients spend blocked on
+ * replies and confirmations, and the server's service time and queue depth.
+ * Counters are plain unsigned longs updated atomically, so all functions are
+ * safe to call from several threads at once.
+ */
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include "local.h"
+
+/*
+ * Client operations (keys for the many-key calls, pairs for bulk loads and
+ * scans)
+ */
+#define METRIC_PUT 0
+#define METRIC_GET 1
+#define METRIC_GET_MANY 2
+#define METRIC_UPDATE 3
+#define METRIC_SIZE 4
+#define METRIC_SYNC 5
+#define METRIC_BULK_LOAD 6
+#define METRIC_SCAN 7
+
+/*
+ * Client traffic and blocking: messages and bytes sent to servers, reply
+ * bytes received, time (and number of times) spent waiting for a reply,
+ * and time spent waiting for put batches and invalidations to be confirmed
+ */
+#define METRIC_CLIENT_MESSAGES 8
+#define METRIC_CLIENT_BYTES_SENT 9
+#define METRIC_CLIENT_BYTES_RECEIVED 10
+#define METRIC_REPLY_WAIT_NS 11
+#define METRIC_REPLY_WAITS 12
+#define METRIC_CONFIRM_WAIT_NS 13
+#define METRIC_CONFIRM_WAITS 14
+
+/*
+ * Messages served, by kind
+ */
+#define METRIC_SERVED_PUT 15
+#define METRIC_SERVED_GET 16
+#define METRIC_SERVED_GET_MANY 17
+#define METRIC_SERVED_UPDATE 18
+#define METRIC_SERVED_SIZE 19
+#define METRIC_SERVED_SCAN 20
+#define METRIC_SERVED_INVALIDATE 21
+#define METRIC_SERVED_REPLICATE 22
+#define METRIC_SERVED_CONFIRM 23
+
+/*
+ * Server traffic and load. Service time runs from the moment a worker picks
+ * a message up to the moment it is done with it (replies included); queue
+ * depth is the number of further messages waiting in the worker's posted
+ * receives by then (at most the number of receives it keeps posted).
+ */
+#define METRIC_SERVER_BYTES_RECEIVED 24
+#define METRIC_SERVER_BYTES_SENT 25
+#define METRIC_SERVICE_NS 26
+#define METRIC_SERVICE_MAX_NS 27
+#define METRIC_QUEUE_DEPTH 28
+#define METRIC_QUEUE_DEPTH_MAX 29
+
+/*
+ * Locality: client operations (keys, as above) on pairs this process owns,
+ * which need no message, and pairs handed to or taken over from other
+ * processes by key migration
+ */
+#define METRIC_LOCAL_OPS 30
+#define METRIC_MIGRATED_OUT 31
+#define METRIC_MIGRATED_IN 32
+
+#define METRICS_COUNT 33
+
+void metrics_init();
+
+void metrics_add(int metric, unsigned long amount);
+
+/*
+ * Raise a *_MAX_* counter to value if it is larger
+ */
+void metrics_max(int metric, unsigned long value);
+
+/*
+ * Monotonic clock in nanoseconds, for timing
+ */
+unsigned long metrics_now_ns();
+
+/*
+ * Copy of every counter (METRICS_COUNT values)
+ */
+void metrics_get(unsigned long *values);
+
+/*
+ * Write the counters of nprocs processes (values holds METRICS_COUNT of
+ * them per process, in rank order) as a JSON report: one object per process
+ * and one for all of them (sums, or maxima for *_MAX_* counters), each with
+ * derived means. Returns false if the file could not be written.
+ */
+bool metrics_write(const char *path, const unsigned long *values, int nprocs);
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * range.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of range partitioning (see range.h).
+ */
+
+#include "range.h"
+
+/*
+ * Helper function: key ordering for qsort
+ */
+static int compare_keys(const void *a, const void *b)
+{
+    return strncmp(a, b, MAX_KEYLEN);
+}
+
+/*
+ * Helper function: number of splitters that compare below key in its first
+ * len characters (or at most equal to it, if inclusive). Splitters are
+ * sorted, so these are always the first ones.
+ */
+static int count_below(const struct range *range, const char *key, size_t len, bool inclusive)
+{
+    int lo = 0;
+    int hi = range->nodes - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strncmp(range->splitters[mid], key, len);
+        if (cmp < 0 || (inclusive && cmp == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void range_init(struct range *range, int nodes)
+{
+    range->nodes = nodes;
+    range->splitters = calloc(nodes > 1 ? nodes - 1 : 1, MAX_KEYLEN);
+}
+
+void range_sort(char *keys, size_t count, size_t pitch)
+{
+    qsort(keys, count, pitch, compare_keys);
+}
+
+void range_split(struct range *range, char *sample, size_t count, size_t pitch)
+{
+    if (count == 0) {
+        return;
+    }
+    range_sort(sample, count, pitch);
+    for (int i = 0; i < range->nodes - 1; i++) {
+        const char *key = sample + (count * (i + 1) / range->nodes) * pitch;
+        snprintf(range->splitters[i], MAX_KEYLEN, "%s", key);
+    }
+}
+
+int range_owner(const struct range *range, const char *key)
+{
+    return count_below(range, key, MAX_KEYLEN, true);
+}
+
+void range_owners(const struct range *range, const struct local_scan *scan,
+                  int *first, int *last)
+{
+    *first = 0;
+    *last = range->nodes - 1;
+    if (scan == NULL) {
+        return;
+    }
+    if (scan->lo != NULL) {
+        *first = count_below(range, scan->lo, MAX_KEYLEN, true);
+    }
+    if (scan->hi != NULL) {
+        // the last key before hi belongs to the slice that hi starts in,
+        // unless hi is a splitter itself
+        int owner = count_below(range, scan->hi, MAX_KEYLEN, false);
+        *last = owner < *last ? owner : *last;
+    }
+    if (scan->prefix != NULL) {
+        // every key with the prefix sorts at most equal to it in its first
+        // strlen(prefix) characters
+        int owner = count_below(range, scan->prefix, strlen(scan->prefix), true);
+        *last = owner < *last ? owner : *last;
+    }
+}
+
+void range_destroy(struct range *range)
+{
+    free(range->splitters);
+    range->splitters = NULL;
+}
@@ -0,0 +1,58 @@
+/**
+ * range.h
+ *
+ * CS 470 Project 4
+ *
+ * Range partitioning used to place keys on processes. nodes-1 splitter keys,
+ * in key order (the byte order of the dump), cut the key space into nodes
+ * contiguous slices; node i owns the keys at or after splitter i-1 and
+ * before splitter i. Ordered scans then only touch the nodes whose slices
+ * they overlap, and every node's dump is one slice of the key space. The
+ * splitters are chosen from a sample of keys so every slice holds about the
+ * same number of them.
+ */
+
+#ifndef __RANGE_H
+#define __RANGE_H
+
+#include "local.h"
+
+struct range {
+    char (*splitters)[MAX_KEYLEN];  // nodes-1 keys, sorted
+    int nodes;
+};
+
+/*
+ * Make room for the splitters of nodes slices. No splitters exist until
+ * range_split chooses them, so range_owner and range_owners must not be
+ * called before then.
+ */
+void range_init(struct range *range, int nodes);
+
+/*
+ * Sort count keys, each at the start of a pitch-byte element, in key order
+ */
+void range_sort(char *keys, size_t count, size_t pitch);
+
+/*
+ * Choose the splitters at the quantiles of a sample of count keys (laid out
+ * as for range_sort; the sample is sorted in place). An empty sample keeps the
+ * current splitters.
+ */
+void range_split(struct range *range, char *sample, size_t count, size_t pitch);
+
+/*
+ * Process that owns a key
+ */
+int range_owner(const struct range *range, const char *key);
+
+/*
+ * Lowest and highest process that may own a key matching a scan (see
+ * local_scan)
+ */
+void range_owners(const struct range *range, const struct local_scan *scan,
+                  int *first, int *last);
+
+void range_destroy(struct range *range);
+
+#endif
@@ -0,0 +1,318 @@
+/**
+ * replay.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the trace replay engine (see replay.h).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <mpi.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dht.h"
+#include "replay.h"
+#include "wire.h"
+
+/*
+ * Private module structure: one "proc" section of the trace, from the line
+ * after its header to the next header
+ */
+struct section {
+    int64_t proc;
+    uint64_t start;
+    uint64_t end;
+};
+
+/*
+ * Helper function: bounds of the next line at or after pos (without the
+ * newline); returns the position after it
+ */
+static size_t next_line(const char *text, size_t size, size_t pos, size_t *end)
+{
+    const char *nl = memchr(text + pos, '\n', size - pos);
+    *end = nl == NULL ? size : (size_t)(nl - text);
+    return nl == NULL ? size : *end + 1;
+}
+
+/*
+ * Helper function: next space-separated word in [*pos, end); returns its
+ * length (zero if there is none) and sets *word
+ */
+static size_t next_word(const char *text, size_t *pos, size_t end, const char **word)
+{
+    while (*pos < end && text[*pos] == ' ') {
+        (*pos)++;
+    }
+    size_t start = *pos;
+    while (*pos < end && text[*pos] != ' ') {
+        (*pos)++;
+    }
+    *word = text + start;
+    return *pos - start;
+}
+
+/*
+ * Helper function: does the word equal a command name?
+ */
+static bool is_command(const char *word, size_t len, const char *name)
+{
+    return len == strlen(name) && memcmp(word, name, len) == 0;
+}
+
+/*
+ * Helper function: index every "proc" section of the trace
+ */
+static struct section *index_sections(const char *text, size_t size, int *count)
+{
+    int cap = 16;
+    struct section *sections = malloc(cap * sizeof(struct section));
+    *count = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t end;
+        size_t next = next_line(text, size, pos, &end);
+        const char *word;
+        size_t p = pos;
+        size_t len = next_word(text, &p, end, &word);
+        if (text[pos] != '#' && is_command(word, len, "proc")) {
+            if (*count > 0) {
+                sections[*count - 1].end = pos;
+            }
+            if (*count == cap) {
+                cap *= 2;
+                sections = realloc(sections, cap * sizeof(struct section));
+            }
+            len = next_word(text, &p, end, &word);
+            char id[32];
+            snprintf(id, sizeof(id), "%.*s", (int)(len < 31 ? len : 31), word);
+            sections[*count].proc = len > 0 ? strtol(id, NULL, 10) : -1;
+            sections[*count].start = next;
+            sections[*count].end = size;
+            (*count)++;
+        }
+        pos = next;
+    }
+    return sections;
+}
+
+/*
+ * Helper function: append one record to the stream
+ */
+static void emit(struct replay *replay, size_t *cap, int op, const char *key,
+        size_t keylen, int flags, long value)
+{
+    if (replay->bytes + WIRE_MAX_RECORD > *cap) {
+        *cap *= 2;
+        replay->ops = realloc(replay->ops, *cap);
+    }
+    char buf[MAX_KEYLEN];
+    if (keylen > MAX_KEYLEN-1) {
+        keylen = MAX_KEYLEN-1;
+    }
+    memcpy(buf, key, keylen);
+    buf[keylen] = '\0';
+    replay->bytes += wire_pack(replay->ops + replay->bytes, op, buf, flags, value);
+    replay->count++;
+}
+
+/*
+ * Helper function: compile the lines of one section
+ */
+static void compile_section(const char *text, const struct section *s,
+        struct replay *replay, size_t *cap)
+{
+    size_t pos = s->start;
+    while (pos < s->end) {
+        size_t end;
+        size_t next = next_line(text, s->end, pos, &end);
+        if (text[pos] == '#') {
+            pos = next;
+            continue;       // comment; skip it
+        }
+        const char *cmd;
+        size_t p = pos;
+        size_t cmd_len = next_word(text, &p, end, &cmd);
+        const char *key;
+        const char *val;
+        size_t key_len;
+        size_t val_len;
+
+        if (cmd_len == 0) {
+            // blank line; skip it
+        } else if (is_command(cmd, cmd_len, "put")) {
+            key_len = next_word(text, &p, end, &key);
+            val_len = next_word(text, &p, end, &val);
+            if (key_len == 0 || val_len == 0) {
+                emit(replay, cap, REPLAY_ERROR, "put", 3, 0, 0);
+            } else {
+                char num[32];
+                snprintf(num, sizeof(num), "%.*s", (int)(val_len < 31 ? val_len : 31), val);
+                emit(replay, cap, WIRE_PUT, key, key_len, WIRE_HAS_VALUE, strtol(num, NULL, 10));
+            }
+        } else if (is_command(cmd, cmd_len, "get")) {
+            key_len = next_word(text, &p, end, &key);
+            if (key_len == 0) {
+                emit(replay, cap, REPLAY_ERROR, "get", 3, 0, 0);
+            } else {
+                emit(replay, cap, WIRE_GET, key, key_len, 0, 0);
+            }
+        } else if (is_command(cmd, cmd_len, "size")) {
+            emit(replay, cap, REPLAY_SIZE, NULL, 0, 0, 0);
+        } else if (is_command(cmd, cmd_len, "sync")) {
+            emit(replay, cap, REPLAY_SYNC, NULL, 0, 0, 0);
+        } else {
+            emit(replay, cap, REPLAY_UNKNOWN, cmd, cmd_len, 0, 0);
+        }
+        pos = next;
+    }
+}
+
+bool replay_compile(const char *path, int pid, struct replay *replay)
+{
+    memset(replay, 0, sizeof(struct replay));
+
+    // every process maps the file; the pages are shared on a node
+    int ok = 1;
+    char *text = NULL;
+    size_t size = 0;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        ok = 0;
+    } else if (st.st_size > 0) {
+        size = (size_t)st.st_size;
+        text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            ok = 0;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!all_ok) {
+        if (ok && text != NULL) {
+            munmap(text, size);
+        }
+        return false;
+    }
+
+    // process 0 finds the sections; everyone else only reads its own
+    int count = 0;
+    struct section *sections = NULL;
+    if (pid == 0) {
+        sections = index_sections(text, size, &count);
+    }
+    MPI_Bcast(&count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (pid != 0) {
+        sections = malloc((count + 1) * sizeof(struct section));
+    }
+    MPI_Bcast(sections, count * (int)sizeof(struct section), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    size_t cap = 4096;
+    replay->ops = malloc(cap);
+    for (int i = 0; i < count; i++) {
+        if (sections[i].proc == pid) {
+            compile_section(text, &sections[i], replay, &cap);
+        }
+    }
+
+    free(sections);
+    if (text != NULL) {
+        munmap(text, size);
+    }
+    return true;
+}
+
+/*
+ * Helper function: print the result of a get the way main.c does
+ */
+static void print_get(const char *key, long value)
+{
+    if (value == KEY_NOT_FOUND) {
+        printf("Key not found: \"%s\"\n", key);
+    } else {
+        printf("Get(\"%s\") = %ld\n", key, value);
+    }
+}
+
+void replay_run(const struct replay *replay)
+{
+    // each process must call sync() exactly once
+    bool synced = false;
+
+    char (*keys)[MAX_KEYLEN] = malloc(REPLAY_LOOKAHEAD * MAX_KEYLEN);
+    const char *key_ptrs[REPLAY_LOOKAHEAD];
+    long values[REPLAY_LOOKAHEAD];
+
+    struct wire_record rec;
+    size_t pos = 0;
+    size_t used;
+    while ((used = wire_unpack(replay->ops + pos, replay->bytes - pos, &rec)) > 0) {
+        pos += used;
+        switch (rec.op) {
+            case WIRE_PUT:
+                dht_put(rec.key, rec.value);
+                break;
+            case WIRE_GET:
+            {
+                // gather the run of gets that follows and look them up
+                // together; nothing in between can change their values
+                int n = 0;
+                memcpy(keys[n++], rec.key, MAX_KEYLEN);
+                size_t ahead;
+                while (n < REPLAY_LOOKAHEAD &&
+                        (ahead = wire_unpack(replay->ops + pos, replay->bytes - pos, &rec)) > 0 &&
+                        rec.op == WIRE_GET) {
+                    memcpy(keys[n++], rec.key, MAX_KEYLEN);
+                    pos += ahead;
+                }
+                if (n == 1) {
+                    values[0] = dht_get(keys[0]);
+                } else {
+                    for (int i = 0; i < n; i++) {
+                        key_ptrs[i] = keys[i];
+                    }
+                    dht_get_many(key_ptrs, n, values);
+                }
+                for (int i = 0; i < n; i++) {
+                    print_get(keys[i], values[i]);
+                }
+                break;
+            }
+            case REPLAY_SIZE:
+                printf("Size = %lu\n", dht_size());
+                break;
+            case REPLAY_SYNC:
+                if (!synced) {
+                    dht_sync();
+                    synced = true;
+                }
+                break;
+            case REPLAY_UNKNOWN:
+                printf("Unrecognized command: \"%s\"\n", rec.key);
+                break;
+            case REPLAY_ERROR:
+                printf("ERROR: '%s' line missing key or value\n", rec.key);
+                break;
+        }
+    }
+    free(keys);
+
+    // every process must call sync() exactly once
+    if (!synced) {
+        dht_sync();
+    }
+}
+
+void replay_free(struct replay *replay)
+{
+    free(replay->ops);
+    memset(replay, 0, sizeof(struct replay));
+}
@@ -0,0 +1,58 @@
+/**
+ * replay.h
+ *
+ * CS 470 Project 4
+ *
+ * Trace replay engine: an alternative to the line-by-line driver in main.c
+ * for large input files. The trace is mapped into memory once; process 0
+ * indexes where every "proc" section starts and shares the index, and each
+ * process then compiles only its own sections into a compact op stream (wire
+ * records, see wire.h) before running it. Runs of consecutive gets are
+ * executed together with dht_get_many, up to a lookahead window at a time.
+ *
+ * For a well-formed trace, get and size results and unrecognized commands
+ * are printed the same way and in the same order as main.c, and dht_sync is
+ * called exactly once per process. Malformed lines and unreadable files get
+ * error messages of their own, and the whole trace is indexed up front
+ * instead of read line by line.
+ */
+
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+#include <stdint.h>
+
+#include "local.h"
+
+// Op stream records besides WIRE_PUT and WIRE_GET
+#define REPLAY_SIZE 16
+#define REPLAY_SYNC 17
+#define REPLAY_UNKNOWN 18   // key is the unrecognized command
+#define REPLAY_ERROR 19     // key is the command of a malformed line
+
+// Gets executed together at most
+#define REPLAY_LOOKAHEAD 256
+
+/*
+ * A process's compiled op stream
+ */
+struct replay {
+    char *ops;              // packed wire records
+    size_t bytes;
+    size_t count;           // number of records
+};
+
+/*
+ * Map a trace and compile the sections of process pid (collective; the DHT
+ * must be initialized). Returns false if the file cannot be read.
+ */
+bool replay_compile(const char *path, int pid, struct replay *replay);
+
+/*
+ * Run a compiled stream against the DHT, printing results to stdout
+ */
+void replay_run(const struct replay *replay);
+
+void replay_free(struct replay *replay);
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * replay_main.c
+ *
+ * CS 470 Project 4
+ *
+ * Driver that runs an input file through the replay engine (see replay.h).
+ * It accepts the same input and writes the same output and dump files as
+ * the driver in main.c.
+ *
+ * Usage: replay <in-file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dht.h"
+#include "replay.h"
+
+int main(int argc, char *argv[])
+{
+    // check command-line parameters
+    if (argc != 2) {
+        printf("Usage: replay <in-file>\n");
+        return EXIT_FAILURE;
+    }
+    char *fn = argv[1];
+
+    // initialize hash table
+    int pid = dht_init();
+
+    // compile this process's part of the input
+    struct replay replay;
+    if (!replay_compile(fn, pid, &replay)) {
+        printf("ERROR: Could not open file \"%s\"\n", fn);
+        return EXIT_FAILURE;
+    }
+    replay_run(&replay);
+    replay_free(&replay);
+
+    // dump and clean up hash table
+    char outfn[64];
+    snprintf(outfn, sizeof(outfn), "dump-%03d.txt", pid);
+    FILE *fout = fopen(outfn, "w");
+    if (fout == NULL) {
+        printf("ERROR: Could not open file \"%s\"\n", outfn);
+    } else {
+        fprintf(fout, "Process %d\n", pid);
+        dht_destroy(fout);
+        fclose(fout);
+    }
+
+    return EXIT_SUCCESS;
+}
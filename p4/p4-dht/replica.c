@@ -0,0 +1,132 @@
+/**
+ * replica.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the hot-key replica store (see replica.h), on a keystore
+ * that reuses entries by clock hand. The keystore's guard words, which
+ * nothing evicts, hold the floor below which replicas of the keys in their
+ * slot are refused: the newest version an owner has invalidated, or
+ * ULONG_MAX once this process has written one of the keys.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+
+#include "keystore.h"
+#include "replica.h"
+
+static struct keystore store;
+static struct replica_stats stats;
+static pthread_mutex_t replica_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void replica_init(size_t size)
+{
+    replica_destroy();
+    pthread_mutex_lock(&replica_lock);
+    keystore_init(&store, size, false);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&replica_lock);
+}
+
+bool replica_lookup(const char *key, long *value)
+{
+    bool hit = false;
+    pthread_mutex_lock(&replica_lock);
+    size_t e = keystore_find(&store, key);
+    if (e != KEYSTORE_NONE && store.entries[e].valid) {
+        *value = store.entries[e].value;
+        stats.hits++;
+        hit = true;
+    }
+    pthread_mutex_unlock(&replica_lock);
+    return hit;
+}
+
+void replica_insert(const char *key, long value, unsigned long version)
+{
+    pthread_mutex_lock(&replica_lock);
+    // an invalidation already seen for a newer version wins, and so does a
+    // write of this process's own
+    if (store.capacity > 0 && version >= *keystore_guard(&store, key)) {
+        size_t e = keystore_find(&store, key);
+        if (e == KEYSTORE_NONE) {
+            e = keystore_add(&store, key);
+        }
+        struct keystore_entry *entry = &store.entries[e];
+        if (version >= entry->version) {
+            entry->value = value;
+            entry->version = version;
+            entry->valid = true;
+            stats.received++;
+        }
+    }
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_invalidate(const char *key, unsigned long version)
+{
+    pthread_mutex_lock(&replica_lock);
+    if (store.capacity > 0) {
+        size_t e = keystore_find(&store, key);
+        if (e != KEYSTORE_NONE && store.entries[e].valid && store.entries[e].version < version) {
+            store.entries[e].valid = false;
+            stats.invalidations++;
+        }
+        // a key written here stays written: this may be the invalidation
+        // for an older write than this process's own
+        unsigned long *floor = keystore_guard(&store, key);
+        if (*floor < version) {
+            *floor = version;
+        }
+    }
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_remove(const char *key)
+{
+    pthread_mutex_lock(&replica_lock);
+    if (store.capacity > 0) {
+        size_t e = keystore_find(&store, key);
+        if (e != KEYSTORE_NONE) {
+            store.entries[e].valid = false;
+        }
+        *keystore_guard(&store, key) = ULONG_MAX;
+    }
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_settle()
+{
+    pthread_mutex_lock(&replica_lock);
+    keystore_reset_guards(&store);
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_count_pushed(unsigned long count)
+{
+    pthread_mutex_lock(&replica_lock);
+    stats.pushed += count;
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_clear()
+{
+    pthread_mutex_lock(&replica_lock);
+    keystore_clear(&store);
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_get_stats(struct replica_stats *out)
+{
+    pthread_mutex_lock(&replica_lock);
+    *out = stats;
+    pthread_mutex_unlock(&replica_lock);
+}
+
+void replica_destroy()
+{
+    pthread_mutex_lock(&replica_lock);
+    keystore_destroy(&store);
+    pthread_mutex_unlock(&replica_lock);
+}
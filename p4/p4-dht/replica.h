@@ -0,0 +1,63 @@
+/**
+ * replica.h
+ *
+ * CS 470 Project 4
+ *
+ * Read-only replicas of hot keys. When an owner sees a key requested often
+ * enough it sends the value and its version to every process, which then
+ * answers dht_get for that key on its own until the owner's invalidation for
+ * a newer version arrives. A fixed number of replicas is kept; all functions
+ * are safe to call from several threads at once.
+ */
+
+#ifndef __REPLICA_H
+#define __REPLICA_H
+
+#include "local.h"
+
+/*
+ * Replica counters. hits is the load shed from owners: every hit is a get
+ * that did not reach the owner's server.
+ */
+struct replica_stats {
+    unsigned long hits;             // gets answered from a replica
+    unsigned long received;         // replicas stored here
+    unsigned long invalidations;    // replicas dropped by an owner's update
+    unsigned long pushed;           // replicas sent out as an owner
+};
+
+void replica_init(size_t capacity);
+
+/*
+ * Look up a key; returns true and sets *value if a current replica is held
+ */
+bool replica_lookup(const char *key, long *value);
+
+/*
+ * Store a replica sent by the key's owner. Ignored if an invalidation for a
+ * newer version has been seen since the last replica_settle(). Those are
+ * remembered by hash slot, so one for another key in the same slot may also
+ * keep the replica out (it is only not stored).
+ */
+void replica_insert(const char *key, long value, unsigned long version);
+
+/*
+ * Drop a replica whose owner has stored a new version
+ */
+void replica_invalidate(const char *key, unsigned long version);
+
+/*
+ * Drop a replica of a key this process has written. Replicas of it are
+ * refused until replica_settle() is called once every invalidation and
+ * replica has been applied; an invalidation that arrives first may be for an
+ * older write, and a replica for that write could still follow it.
+ */
+void replica_remove(const char *key);
+void replica_settle();
+
+void replica_count_pushed(unsigned long count);
+void replica_clear();
+void replica_get_stats(struct replica_stats *stats);
+void replica_destroy();
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * ring.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the consistent-hash ring (see ring.h).
+ */
+
+#include "ring.h"
+
+/*
+ * Helper function: MurmurHash3 finalizer; spreads every input bit over the
+ * whole word so similar keys land far apart on the ring
+ */
+static uint32_t mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t ring_hash_djb2(const char *key)
+{
+    uint32_t h = 5381;
+    for (size_t i = 0; i < MAX_KEYLEN-1 && key[i] != '\0'; i++) {
+        h = ((h << 5) + h) + (unsigned)key[i];
+    }
+    return h;
+}
+
+uint32_t ring_hash_fnv1a(const char *key)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < MAX_KEYLEN-1 && key[i] != '\0'; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t ring_hash_murmur(const char *key)
+{
+    size_t len = 0;
+    while (len < MAX_KEYLEN-1 && key[len] != '\0') {
+        len++;
+    }
+
+    uint32_t h = 0x9747b28cu;
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t k = (uint32_t)(unsigned char)key[i]
+            | (uint32_t)(unsigned char)key[i+1] << 8
+            | (uint32_t)(unsigned char)key[i+2] << 16
+            | (uint32_t)(unsigned char)key[i+3] << 24;
+        k *= 0xcc9e2d51u;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593u;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64u;
+    }
+    uint32_t k = 0;
+    switch (len & 3) {
+        case 3: k ^= (uint32_t)(unsigned char)key[i+2] << 16;   // fall through
+        case 2: k ^= (uint32_t)(unsigned char)key[i+1] << 8;    // fall through
+        case 1: k ^= (uint32_t)(unsigned char)key[i];
+                k *= 0xcc9e2d51u;
+                k = (k << 15) | (k >> 17);
+                k *= 0x1b873593u;
+                h ^= k;
+    }
+    return mix(h ^ (uint32_t)len);
+}
+
+ring_hash_fn ring_hash_by_name(const char *name)
+{
+    if (strcmp(name, "djb2") == 0) {
+        return ring_hash_djb2;
+    } else if (strcmp(name, "fnv1a") == 0) {
+        return ring_hash_fnv1a;
+    } else if (strcmp(name, "murmur") == 0) {
+        return ring_hash_murmur;
+    }
+    return NULL;
+}
+
+/*
+ * Helper function: ordering for qsort; ties (vanishingly rare) are broken by
+ * node so every process builds the same ring
+ */
+static int compare_points(const void *a, const void *b)
+{
+    const struct ring_point *pa = a;
+    const struct ring_point *pb = b;
+    if (pa->pos != pb->pos) {
+        return pa->pos < pb->pos ? -1 : 1;
+    }
+    return pa->node - pb->node;
+}
+
+void ring_init(struct ring *ring, int nodes, int vnodes, ring_hash_fn hash)
+{
+    if (vnodes < 1) {
+        vnodes = 1;
+    }
+    ring->hash = hash;
+    ring->count = (size_t)nodes * vnodes;
+    ring->points = malloc(ring->count * sizeof(struct ring_point));
+
+    // a point depends only on its node and index, so growing the ring keeps
+    // the existing points where they are
+    size_t p = 0;
+    for (int n = 0; n < nodes; n++) {
+        for (int v = 0; v < vnodes; v++) {
+            char name[32];
+            snprintf(name, sizeof(name), "node%d#%d", n, v);
+            ring->points[p].pos = mix(hash(name));
+            ring->points[p].node = n;
+            p++;
+        }
+    }
+    qsort(ring->points, ring->count, sizeof(struct ring_point), compare_points);
+}
+
+int ring_owner(const struct ring *ring, const char *key)
+{
+    uint32_t pos = mix(ring->hash(key));
+
+    // first point at or after pos, wrapping around to the first point
+    size_t lo = 0;
+    size_t hi = ring->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ring->points[mid].pos < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return ring->points[lo == ring->count ? 0 : lo].node;
+}
+
+void ring_destroy(struct ring *ring)
+{
+    free(ring->points);
+    ring->points = NULL;
+    ring->count = 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * ring.h
+ *
+ * CS 470 Project 4
+ *
+ * Consistent-hash ring used to place keys on processes. Every process owns a
+ * number of virtual nodes (points on a 32-bit ring); a key belongs to the
+ * process owning the first point at or after the key's position. Adding a
+ * process only moves the keys that fall just before its new points, and more
+ * virtual nodes per process even out the share of the ring each one gets.
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdint.h>
+
+#include "local.h"
+
+/*
+ * Key hash function; keys are hashed up to MAX_KEYLEN-1 characters. The ring
+ * mixes the result further, so a function with weak high bits is fine.
+ */
+typedef uint32_t (*ring_hash_fn)(const char *key);
+
+uint32_t ring_hash_djb2(const char *key);     // the project's original hash
+uint32_t ring_hash_fnv1a(const char *key);
+uint32_t ring_hash_murmur(const char *key);   // MurmurHash3 (x86, 32-bit)
+
+/*
+ * Hash function with the given name ("djb2", "fnv1a" or "murmur"), or NULL
+ */
+ring_hash_fn ring_hash_by_name(const char *name);
+
+struct ring_point {
+    uint32_t pos;
+    int node;
+};
+
+struct ring {
+    struct ring_point *points;  // sorted by position
+    size_t count;
+    ring_hash_fn hash;
+};
+
+/*
+ * Build a ring of nodes processes with vnodes points each
+ */
+void ring_init(struct ring *ring, int nodes, int vnodes, ring_hash_fn hash);
+
+/*
+ * Process that owns a key
+ */
+int ring_owner(const struct ring *ring, const char *key);
+
+void ring_destroy(struct ring *ring);
+
+#endif
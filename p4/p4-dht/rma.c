@@ -0,0 +1,442 @@
+/**
+ * rma.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the one-sided DHT backend (see rma.h).
+ *
+ * Window layout: an 8-byte key count followed by the slots. A slot's state
+ * word is zero while it is empty; a put claims it by swapping in the key's
+ * hash tagged as "writing", stores the key and value, and then tags it
+ * "ready". Readers that meet a slot being written for the same hash wait for
+ * it to become ready. Keys never leave a slot once written, and the state
+ * and value words are only accessed with atomic operations, so no locks are
+ * needed. The whole window stays in one passive-target epoch (MPI_Win_lock_all)
+ * and every operation is completed with MPI_Win_flush.
+ *
+ * With the shared-memory fast path, the slots are allocated with
+ * MPI_Win_allocate_shared on the communicator of the ranks on this node.
+ * The same memory is also exposed to the other nodes through an
+ * MPI_Win_create window. Slots of co-located ranks are then read and
+ * written with plain loads, stores and processor atomics (with the same
+ * ordering the MPI path gets from its flushes).
+ */
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rma.h"
+#include "ring.h"
+#include "snapshot.h"
+
+#define STATE_EMPTY 0
+#define STATE_WRITING 1
+#define STATE_READY 2
+
+#define MAKE_STATE(hash, tag) (((int64_t)(hash) << 2) | (tag))
+
+/*
+ * Private module structure: one slot as laid out in the window
+ */
+struct rma_slot {
+    int64_t state;
+    int64_t value;
+    char key[MAX_KEYLEN];
+};
+
+#define HEADER_BYTES ((MPI_Aint)sizeof(int64_t))
+
+// Slots read at once by a scan
+#define SCAN_SLOTS 256
+#define SLOT_DISP(i) (HEADER_BYTES + (MPI_Aint)(i) * (MPI_Aint)sizeof(struct rma_slot))
+
+static MPI_Win win;
+static MPI_Comm win_comm;
+static char *base;
+static size_t slot_count;
+
+// Shared-memory fast path: window and communicator of this node's ranks, and
+// the address of every world rank's slots if it is on this node (else NULL)
+static MPI_Win node_win = MPI_WIN_NULL;
+static MPI_Comm node_comm = MPI_COMM_NULL;
+static char **peer_base;
+
+/*
+ * Helper functions: atomic accesses to one 8-byte word of a target's window
+ */
+static int64_t fetch_word(int target, MPI_Aint disp)
+{
+    if (peer_base[target] != NULL) {
+        return __atomic_load_n((int64_t *)(peer_base[target] + disp), __ATOMIC_ACQUIRE);
+    }
+    int64_t result;
+    MPI_Fetch_and_op(NULL, &result, MPI_INT64_T, target, disp, MPI_NO_OP, win);
+    MPI_Win_flush(target, win);
+    return result;
+}
+
+static void store_word(int target, MPI_Aint disp, int64_t value)
+{
+    if (peer_base[target] != NULL) {
+        __atomic_store_n((int64_t *)(peer_base[target] + disp), value, __ATOMIC_RELEASE);
+        return;
+    }
+    MPI_Accumulate(&value, 1, MPI_INT64_T, target, disp, 1, MPI_INT64_T, MPI_REPLACE, win);
+    MPI_Win_flush(target, win);
+}
+
+static int64_t swap_word(int target, MPI_Aint disp, int64_t expected, int64_t desired)
+{
+    if (peer_base[target] != NULL) {
+        return __sync_val_compare_and_swap((int64_t *)(peer_base[target] + disp),
+                expected, desired);
+    }
+    int64_t result;
+    MPI_Compare_and_swap(&desired, &expected, &result, MPI_INT64_T, target, disp, win);
+    MPI_Win_flush(target, win);
+    return result;
+}
+
+static void add_word(int target, MPI_Aint disp, int64_t value)
+{
+    if (peer_base[target] != NULL) {
+        __sync_fetch_and_add((int64_t *)(peer_base[target] + disp), value);
+        return;
+    }
+    MPI_Accumulate(&value, 1, MPI_INT64_T, target, disp, 1, MPI_INT64_T, MPI_SUM, win);
+    MPI_Win_flush(target, win);
+}
+
+static int64_t fetch_op_word(int target, MPI_Aint disp, int64_t value, MPI_Op op)
+{
+    if (peer_base[target] != NULL) {
+        int64_t *word = (int64_t *)(peer_base[target] + disp);
+        if (op == MPI_SUM) {
+            return __sync_fetch_and_add(word, value);
+        }
+        int64_t old = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        while (old < value) {
+            int64_t seen = __sync_val_compare_and_swap(word, old, value);
+            if (seen == old) {
+                break;
+            }
+            old = seen;
+        }
+        return old;
+    }
+    int64_t result;
+    MPI_Fetch_and_op(&value, &result, MPI_INT64_T, target, disp, op, win);
+    MPI_Win_flush(target, win);
+    return result;
+}
+
+/*
+ * Helper functions: copy a key out of / into a slot. Keys are only written
+ * before their slot is published, so no atomics are needed.
+ */
+static void get_key(int target, size_t i, char *key)
+{
+    MPI_Aint disp = SLOT_DISP(i) + offsetof(struct rma_slot, key);
+    if (peer_base[target] != NULL) {
+        memcpy(key, peer_base[target] + disp, MAX_KEYLEN);
+        return;
+    }
+    MPI_Get(key, MAX_KEYLEN, MPI_CHAR, target, disp, MAX_KEYLEN, MPI_CHAR, win);
+    MPI_Win_flush(target, win);
+}
+
+static void put_key(int target, size_t i, const char *key)
+{
+    MPI_Aint disp = SLOT_DISP(i) + offsetof(struct rma_slot, key);
+    if (peer_base[target] != NULL) {
+        memcpy(peer_base[target] + disp, key, MAX_KEYLEN);
+        return;
+    }
+    MPI_Put(key, MAX_KEYLEN, MPI_CHAR, target, disp, MAX_KEYLEN, MPI_CHAR, win);
+    MPI_Win_flush(target, win);
+}
+
+/*
+ * Helper function: does the ready slot i on target hold key?
+ */
+static bool slot_has_key(int target, size_t i, const char *key)
+{
+    char stored[MAX_KEYLEN];
+    get_key(target, i, stored);
+    return strncmp(stored, key, MAX_KEYLEN-1) == 0;
+}
+
+/*
+ * Helper function: wait until a slot that is being written is ready
+ */
+static int64_t wait_ready(int target, size_t i)
+{
+    int64_t state;
+    do {
+        state = fetch_word(target, SLOT_DISP(i));
+    } while ((state & 3) == STATE_WRITING);
+    return state;
+}
+
+void rma_init(size_t slots, bool shm)
+{
+    int nprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    peer_base = calloc(nprocs, sizeof(char *));
+
+    slot_count = 1;
+    while (slot_count < slots) {
+        slot_count *= 2;
+    }
+    MPI_Comm_dup(MPI_COMM_WORLD, &win_comm);
+    MPI_Aint bytes = SLOT_DISP(slot_count);
+
+    if (shm) {
+
+        // allocate the slots in memory shared with this node's ranks and
+        // find where every co-located rank's slots are mapped
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+        int node_size;
+        MPI_Comm_size(node_comm, &node_size);
+        MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, node_comm, &base, &node_win);
+
+        MPI_Group world_group, node_group;
+        MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+        MPI_Comm_group(node_comm, &node_group);
+        int *node_ranks = malloc(node_size * sizeof(int));
+        int *world_ranks = malloc(node_size * sizeof(int));
+        for (int i = 0; i < node_size; i++) {
+            node_ranks[i] = i;
+        }
+        MPI_Group_translate_ranks(node_group, node_size, node_ranks, world_group, world_ranks);
+        for (int i = 0; i < node_size; i++) {
+            MPI_Aint size;
+            int disp_unit;
+            MPI_Win_shared_query(node_win, i, &size, &disp_unit, &peer_base[world_ranks[i]]);
+        }
+        free(node_ranks);
+        free(world_ranks);
+        MPI_Group_free(&world_group);
+        MPI_Group_free(&node_group);
+
+        if (node_size == nprocs) {
+
+            // every rank is on this node, so every access is direct
+            win = node_win;
+            node_win = MPI_WIN_NULL;
+        } else {
+
+            // the other nodes reach the same memory through an ordinary window
+            MPI_Win_create(base, bytes, 1, MPI_INFO_NULL, win_comm, &win);
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, node_win);
+        }
+    } else {
+        MPI_Win_allocate(bytes, 1, MPI_INFO_NULL, win_comm, &base, &win);
+    }
+
+    // MPI_Win_allocate does not clear the memory; every process must be done
+    // clearing its own slots before anyone writes to them
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    memset(base, 0, bytes);
+    MPI_Win_sync(win);
+    if (node_win != MPI_WIN_NULL) {
+        MPI_Win_sync(node_win);
+    }
+    MPI_Barrier(win_comm);
+}
+
+/*
+ * Helper function: find the slot of a key on target. If the key is missing
+ * and create is set, an empty slot is claimed for it and returned in the
+ * writing state with the key stored; the caller stores the value and
+ * publishes it with publish_slot.
+ */
+#define SLOT_MISSING 0
+#define SLOT_FOUND 1
+#define SLOT_CLAIMED 2
+
+static int find_slot(int target, const char *key, bool create, size_t *index)
+{
+    uint32_t h = ring_hash_fnv1a(key);
+    int64_t writing = MAKE_STATE(h, STATE_WRITING);
+    size_t mask = slot_count - 1;
+
+    for (size_t probe = 0; probe < slot_count; probe++) {
+        size_t i = (h + probe) & mask;
+        *index = i;
+
+        // try to claim the slot for this key (or just look at it)
+        int64_t state = create ?
+            swap_word(target, SLOT_DISP(i), STATE_EMPTY, writing) :
+            fetch_word(target, SLOT_DISP(i));
+
+        if (state == STATE_EMPTY) {
+            if (!create) {
+                return SLOT_MISSING;
+            }
+
+            // new key: store it; the caller publishes the slot
+            char stored[MAX_KEYLEN];
+            memset(stored, 0, MAX_KEYLEN);
+            for (size_t c = 0; c < MAX_KEYLEN-1 && key[c] != '\0'; c++) {
+                stored[c] = key[c];
+            }
+            put_key(target, i, stored);
+            return SLOT_CLAIMED;
+        }
+
+        // occupied; is it the same key?
+        if ((state >> 2) == h) {
+            wait_ready(target, i);
+            if (slot_has_key(target, i, key)) {
+                return SLOT_FOUND;
+            }
+        }
+    }
+
+    if (!create) {
+        return SLOT_MISSING;
+    }
+    fprintf(stderr, "ERROR: all %lu RMA slots of process %d are full "
+            "(raise DHT_RMA_SLOTS)\n", (unsigned long)slot_count, target);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    return SLOT_MISSING;
+}
+
+/*
+ * Helper function: store the first value of a claimed slot and publish it
+ */
+static void publish_slot(int target, size_t i, const char *key, long value)
+{
+    store_word(target, SLOT_DISP(i) + offsetof(struct rma_slot, value), value);
+    store_word(target, SLOT_DISP(i), MAKE_STATE(ring_hash_fnv1a(key), STATE_READY));
+    add_word(target, 0, 1);
+}
+
+void rma_put(int dest, const char *key, long value)
+{
+    size_t i;
+    if (find_slot(dest, key, true, &i) == SLOT_CLAIMED) {
+        publish_slot(dest, i, key, value);
+    } else {
+        store_word(dest, SLOT_DISP(i) + offsetof(struct rma_slot, value), value);
+    }
+}
+
+long rma_get(int source, const char *key)
+{
+    size_t i;
+    if (find_slot(source, key, false, &i) != SLOT_FOUND) {
+        return KEY_NOT_FOUND;
+    }
+    return (long)fetch_word(source, SLOT_DISP(i) + offsetof(struct rma_slot, value));
+}
+
+long rma_update(int dest, int op, const char *key, long operand, long expected)
+{
+    // a swap that needs the key to exist must not create it
+    size_t i;
+    bool create = op != LOCAL_CAS || expected == KEY_NOT_FOUND;
+    int found = find_slot(dest, key, create, &i);
+    if (found == SLOT_MISSING) {
+        return KEY_NOT_FOUND;
+    }
+    if (found == SLOT_CLAIMED) {
+        publish_slot(dest, i, key, operand);
+        return op == LOCAL_ADD ? operand : KEY_NOT_FOUND;
+    }
+
+    MPI_Aint disp = SLOT_DISP(i) + offsetof(struct rma_slot, value);
+    switch (op) {
+        case LOCAL_ADD:
+            return (long)fetch_op_word(dest, disp, operand, MPI_SUM) + operand;
+        case LOCAL_CAS:
+            return (long)swap_word(dest, disp, expected, operand);
+        case LOCAL_MAX:
+            return (long)fetch_op_word(dest, disp, operand, MPI_MAX);
+    }
+    return KEY_NOT_FOUND;
+}
+
+size_t rma_count(int target)
+{
+    return (size_t)fetch_word(target, 0);
+}
+
+/*
+ * Helper function: ordering for qsort of scan results
+ */
+static int compare_pairs(const void *a, const void *b)
+{
+    return strncmp(((const struct snapshot_pair *)a)->key,
+                   ((const struct snapshot_pair *)b)->key, MAX_KEYLEN);
+}
+
+struct snapshot_pair *rma_scan(int target, const struct local_scan *scan, size_t *count)
+{
+    size_t n = 0;
+    size_t cap = 64;
+    struct snapshot_pair *pairs = malloc(cap * sizeof(struct snapshot_pair));
+    struct rma_slot *block = malloc(SCAN_SLOTS * sizeof(struct rma_slot));
+
+    for (size_t first = 0; first < slot_count; first += SCAN_SLOTS) {
+        size_t slots = slot_count - first < SCAN_SLOTS ? slot_count - first : SCAN_SLOTS;
+        int bytes = (int)(slots * sizeof(struct rma_slot));
+        if (peer_base[target] != NULL) {
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            memcpy(block, peer_base[target] + SLOT_DISP(first), bytes);
+        } else {
+            MPI_Get(block, bytes, MPI_BYTE, target, SLOT_DISP(first), bytes, MPI_BYTE, win);
+            MPI_Win_flush(target, win);
+        }
+
+        // a ready slot's key never changes, but its value is only read
+        // atomically
+        for (size_t i = 0; i < slots; i++) {
+            if ((block[i].state & 3) != STATE_READY ||
+                    !local_scan_match(scan, block[i].key)) {
+                continue;
+            }
+            if (n == cap) {
+                cap *= 2;
+                pairs = realloc(pairs, cap * sizeof(struct snapshot_pair));
+            }
+            memcpy(pairs[n].key, block[i].key, MAX_KEYLEN);
+            pairs[n].key[MAX_KEYLEN-1] = '\0';
+            pairs[n].value = fetch_word(target, SLOT_DISP(first + i) + offsetof(struct rma_slot, value));
+            n++;
+        }
+    }
+    free(block);
+    qsort(pairs, n, sizeof(struct snapshot_pair), compare_pairs);
+    *count = n;
+    return pairs;
+}
+
+void rma_export()
+{
+    MPI_Win_sync(win);
+    for (size_t i = 0; i < slot_count; i++) {
+        struct rma_slot *slot = (struct rma_slot *)(base + SLOT_DISP(i));
+        if ((slot->state & 3) == STATE_READY) {
+            local_put(slot->key, (long)slot->value);
+        }
+    }
+}
+
+void rma_destroy()
+{
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+    if (node_win != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(node_win);
+        MPI_Win_free(&node_win);
+    }
+    if (node_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&node_comm);
+    }
+    MPI_Comm_free(&win_comm);
+    free(peer_base);
+    peer_base = NULL;
+}
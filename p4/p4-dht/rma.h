@@ -0,0 +1,62 @@
+/**
+ * rma.h
+ *
+ * CS 470 Project 4
+ *
+ * One-sided (MPI RMA) backend for the DHT. Every process exposes a fixed
+ * number of key-value slots in an MPI window, laid out as an open-addressing
+ * hash table; other processes read and write them directly with MPI_Get,
+ * MPI_Accumulate, MPI_Fetch_and_op and MPI_Compare_and_swap, so no server
+ * thread is involved.
+ * All functions must be called from the thread that initialized MPI.
+ *
+ * Optionally, processes on the same node place their slots in shared memory
+ * and access each other's directly, without MPI calls. Direct and MPI
+ * accesses to the same slot are only atomic with respect to each other if
+ * the MPI library implements window atomics with processor atomics, so jobs
+ * spanning several nodes should be checked on the target system.
+ */
+
+#ifndef __RMA_H
+#define __RMA_H
+
+#include "local.h"
+
+/*
+ * Create the window (collective); slots is rounded up to a power of two.
+ * With shm set, co-located processes share their slots.
+ */
+void rma_init(size_t slots, bool shm);
+
+void rma_put(int dest, const char *key, long value);
+long rma_get(int source, const char *key);
+
+/*
+ * Atomic read-modify-write of one key (op is LOCAL_ADD, LOCAL_CAS or
+ * LOCAL_MAX, with the results of local_update)
+ */
+long rma_update(int dest, int op, const char *key, long operand, long expected);
+
+/*
+ * Number of keys stored on one process
+ */
+size_t rma_count(int target);
+
+/*
+ * Copy of the pairs stored on one process that match scan (see local.h),
+ * sorted by key and laid out as in a snapshot (free it when done). Pairs put
+ * while the scan runs may or may not be seen.
+ */
+struct snapshot_pair *rma_scan(int target, const struct local_scan *scan, size_t *count);
+
+/*
+ * Copy this process's slots into the local table (for dumping it)
+ */
+void rma_export();
+
+/*
+ * Free the window (collective)
+ */
+void rma_destroy();
+
+#endif
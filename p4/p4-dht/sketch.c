@@ -0,0 +1,72 @@
+/**
+ * sketch.c
+ *
+ * CS 470 Project 4
+ *
+ * Implementation of the count-min sketch (see sketch.h). The row positions
+ * of a key come from two independent hashes by double hashing.
+ */
+
+#include "ring.h"
+#include "sketch.h"
+
+/*
+ * Helper function: position of a key in every row
+ */
+static void positions(const struct sketch *sketch, const char *key, size_t *pos)
+{
+    uint32_t h1 = ring_hash_fnv1a(key);
+    uint32_t h2 = ring_hash_murmur(key) | 1;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        pos[row] = row * sketch->width + ((h1 + (uint32_t)row * h2) & (sketch->width - 1));
+    }
+}
+
+void sketch_init(struct sketch *sketch, size_t width, unsigned long window)
+{
+    sketch->width = 1;
+    while (sketch->width < width) {
+        sketch->width *= 2;
+    }
+    sketch->counts = calloc(SKETCH_DEPTH * sketch->width, sizeof(uint32_t));
+    sketch->window = window;
+    sketch->added = 0;
+}
+
+uint32_t sketch_add(struct sketch *sketch, const char *key)
+{
+    // age every estimate once a window has passed
+    if (++sketch->added > sketch->window) {
+        for (size_t i = 0; i < SKETCH_DEPTH * sketch->width; i++) {
+            sketch->counts[i] >>= 1;
+        }
+        sketch->added = 1;
+    }
+
+    size_t pos[SKETCH_DEPTH];
+    positions(sketch, key, pos);
+    uint32_t estimate = UINT32_MAX;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        uint32_t count = ++sketch->counts[pos[row]];
+        if (count < estimate) {
+            estimate = count;
+        }
+    }
+    return estimate;
+}
+
+void sketch_forget(struct sketch *sketch, const char *key, uint32_t amount)
+{
+    size_t pos[SKETCH_DEPTH];
+    positions(sketch, key, pos);
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        uint32_t *count = &sketch->counts[pos[row]];
+        *count = *count > amount ? *count - amount : 0;
+    }
+}
+
+void sketch_destroy(struct sketch *sketch)
+{
+    free(sketch->counts);
+    sketch->counts = NULL;
+}
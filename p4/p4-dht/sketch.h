@@ -0,0 +1,43 @@
+/**
+ * sketch.h
+ *
+ * CS 470 Project 4
+ *
+ * Count-min sketch for spotting frequently accessed keys in a fixed amount
+ * of memory. Each key increments one counter in each of a few rows; the
+ * smallest of its counters never underestimates how often it was seen.
+ * Counters are halved every window additions, so the estimates follow
+ * recent traffic. A sketch is not locked; each thread keeps its own.
+ */
+
+#ifndef __SKETCH_H
+#define __SKETCH_H
+
+#include <stdint.h>
+
+#include "local.h"
+
+#define SKETCH_DEPTH 4
+
+struct sketch {
+    uint32_t *counts;           // SKETCH_DEPTH rows of width counters
+    size_t width;               // power of two
+    unsigned long window;       // additions between halvings
+    unsigned long added;        // additions since the last halving
+};
+
+void sketch_init(struct sketch *sketch, size_t width, unsigned long window);
+
+/*
+ * Count one access to a key and return its estimated count
+ */
+uint32_t sketch_add(struct sketch *sketch, const char *key);
+
+/*
+ * Take amount off a key's counters (e.g. once it has been acted on)
+ */
+void sketch_forget(struct sketch *sketch, const char *key, uint32_t amount);
+
+void sketch_destroy(struct sketch *sketch);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * snapshot.c
+ *
+ * CS 470 Project 4
+ *
+ * Writing and mapping of binary shard snapshots (see snapshot.h).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+/*
+ * Helper function: 64-bit FNV-1a over a block of bytes, continuing from h
+ */
+static uint64_t checksum(uint64_t h, const void *data, size_t bytes)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < bytes; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+#define CHECKSUM_SEED 14695981039346656037ull
+
+uint32_t snapshot_key_hash(const char *key)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < MAX_KEYLEN-1 && key[i] != '\0'; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Helper function: write a whole buffer, retrying short writes
+ */
+static bool write_all(int fd, const void *data, size_t bytes)
+{
+    const char *p = data;
+    while (bytes > 0) {
+        ssize_t n = write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        bytes -= (size_t)n;
+    }
+    return true;
+}
+
+bool snapshot_write(const char *path, const struct snapshot_pair *pairs,
+        size_t count, uint32_t rank, uint32_t nprocs, uint32_t placement)
+{
+    // build the index at a load factor of at most one half
+    size_t slot_count = 1024;
+    while (slot_count < 2 * count) {
+        slot_count *= 2;
+    }
+    struct snapshot_slot *slots = calloc(slot_count, sizeof(struct snapshot_slot));
+    if (slots == NULL) {
+        fprintf(stderr, "ERROR: snapshot \"%s\": out of memory\n", path);
+        return false;
+    }
+    for (size_t p = 0; p < count; p++) {
+        uint32_t h = snapshot_key_hash(pairs[p].key);
+        size_t i = h & (slot_count - 1);
+        while (slots[i].index != 0) {
+            i = (i + 1) & (slot_count - 1);
+        }
+        slots[i].hash = h;
+        slots[i].index = (uint32_t)(p + 1);
+    }
+
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, SNAPSHOT_MAGIC);
+    header.format = SNAPSHOT_FORMAT;
+    header.keylen = MAX_KEYLEN;
+    header.rank = rank;
+    header.nprocs = nprocs;
+    header.placement = placement;
+    header.pair_count = count;
+    header.slot_count = slot_count;
+    header.pairs_offset = sizeof(header);
+    header.slots_offset = header.pairs_offset + count * sizeof(struct snapshot_pair);
+    header.pairs_checksum = checksum(CHECKSUM_SEED, pairs, count * sizeof(struct snapshot_pair));
+    header.slots_checksum = checksum(CHECKSUM_SEED, slots, slot_count * sizeof(struct snapshot_slot));
+    header.header_checksum = checksum(CHECKSUM_SEED, &header,
+            offsetof(struct snapshot_header, header_checksum));
+
+    // write to a temporary name and rename, so a crash never leaves a
+    // half-written snapshot under the real name
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0
+        && write_all(fd, &header, sizeof(header))
+        && write_all(fd, pairs, count * sizeof(struct snapshot_pair))
+        && write_all(fd, slots, slot_count * sizeof(struct snapshot_slot));
+    if (fd >= 0) {
+        ok = close(fd) == 0 && ok;
+    }
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "ERROR: could not write snapshot \"%s\": %s\n", path, strerror(errno));
+        unlink(tmp);
+    }
+    free(slots);
+    return ok;
+}
+
+bool snapshot_open(const char *path, struct snapshot *snap, bool verify)
+{
+    memset(snap, 0, sizeof(struct snapshot));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open snapshot \"%s\": %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+        fprintf(stderr, "ERROR: snapshot \"%s\" is truncated\n", path);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not map snapshot \"%s\": %s\n", path, strerror(errno));
+        return false;
+    }
+    snap->map = map;
+    snap->map_bytes = (size_t)st.st_size;
+
+    const struct snapshot_header *header = map;
+    const char *problem = NULL;
+    if (strncmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        problem = "not a snapshot";
+    } else if (header->header_checksum != checksum(CHECKSUM_SEED, header,
+                offsetof(struct snapshot_header, header_checksum))) {
+        problem = "header checksum mismatch";
+    } else if (header->format != SNAPSHOT_FORMAT || header->keylen != MAX_KEYLEN) {
+        problem = "written by an incompatible version";
+    } else if (header->slots_offset + header->slot_count * sizeof(struct snapshot_slot)
+            != snap->map_bytes
+            || header->pairs_offset + header->pair_count * sizeof(struct snapshot_pair)
+            != header->slots_offset) {
+        problem = "truncated";
+    } else if (verify && (header->pairs_checksum != checksum(CHECKSUM_SEED,
+                (const char *)map + header->pairs_offset,
+                header->pair_count * sizeof(struct snapshot_pair))
+            || header->slots_checksum != checksum(CHECKSUM_SEED,
+                (const char *)map + header->slots_offset,
+                header->slot_count * sizeof(struct snapshot_slot)))) {
+        problem = "data checksum mismatch";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "ERROR: snapshot \"%s\": %s\n", path, problem);
+        snapshot_close(snap);
+        return false;
+    }
+
+    snap->header = header;
+    snap->pairs = (const struct snapshot_pair *)((const char *)map + header->pairs_offset);
+    snap->slots = (const struct snapshot_slot *)((const char *)map + header->slots_offset);
+    return true;
+}
+
+const struct snapshot_pair *snapshot_find(const struct snapshot *snap,
+        const char *key, uint32_t h)
+{
+    size_t mask = snap->header->slot_count - 1;
+    size_t i = h & mask;
+    while (snap->slots[i].index != 0) {
+        if (snap->slots[i].hash == h) {
+            const struct snapshot_pair *pair = &snap->pairs[snap->slots[i].index - 1];
+            if (strncmp(key, pair->key, MAX_KEYLEN-1) == 0) {
+                return pair;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+void snapshot_close(struct snapshot *snap)
+{
+    if (snap->map != NULL) {
+        munmap(snap->map, snap->map_bytes);
+    }
+    memset(snap, 0, sizeof(struct snapshot));
+}
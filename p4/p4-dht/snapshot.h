@@ -0,0 +1,96 @@
+/**
+ * snapshot.h
+ *
+ * CS 470 Project 4
+ *
+ * Binary snapshot of one process's part of the DHT. The file is laid out so
+ * it can be used in place once mapped into memory:
+ *
+ *   header     fixed size, see below
+ *   pairs      pair_count fixed-size key-value pairs, sorted by key
+ *   index      slot_count hash slots (open addressing, linear probing) whose
+ *              index is a pair number plus one (zero means empty)
+ *
+ * The header carries a checksum of itself and of each section (64-bit
+ * FNV-1a). Opening a snapshot only checks the header, so it takes constant
+ * time; the sections are checked on request.
+ */
+
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "local.h"
+
+#define SNAPSHOT_MAGIC "DHTSNAP"
+#define SNAPSHOT_FORMAT 1
+
+struct snapshot_header {
+    char magic[8];              // SNAPSHOT_MAGIC, NUL-terminated
+    uint32_t format;            // SNAPSHOT_FORMAT
+    uint32_t keylen;            // MAX_KEYLEN of the writer
+    uint32_t rank;              // process that wrote the snapshot
+    uint32_t nprocs;            // number of processes at the time
+    uint32_t placement;         // fingerprint of the key placement in use
+    uint32_t reserved;
+    uint64_t pair_count;
+    uint64_t slot_count;        // power of two
+    uint64_t pairs_offset;      // byte offsets from the start of the file
+    uint64_t slots_offset;
+    uint64_t pairs_checksum;
+    uint64_t slots_checksum;
+    uint64_t header_checksum;   // of every field above
+};
+
+struct snapshot_pair {
+    char key[MAX_KEYLEN];
+    int64_t value;
+};
+
+struct snapshot_slot {
+    uint32_t hash;              // snapshot_key_hash of the key
+    uint32_t index;             // pair index plus one (zero means empty)
+};
+
+/*
+ * A snapshot mapped into memory (read-only)
+ */
+struct snapshot {
+    void *map;
+    size_t map_bytes;
+    const struct snapshot_header *header;
+    const struct snapshot_pair *pairs;
+    const struct snapshot_slot *slots;
+};
+
+/*
+ * Hash of a key used by the index (32-bit FNV-1a of at most MAX_KEYLEN-1
+ * characters; the same hash the local table uses)
+ */
+uint32_t snapshot_key_hash(const char *key);
+
+/*
+ * Write count pairs, which must be sorted by key and distinct, as a snapshot
+ * file. Returns false (with a message on stderr) if the file cannot be
+ * written.
+ */
+bool snapshot_write(const char *path, const struct snapshot_pair *pairs,
+        size_t count, uint32_t rank, uint32_t nprocs, uint32_t placement);
+
+/*
+ * Map a snapshot. With verify set, the section checksums are checked too.
+ * Returns false (with a message on stderr) if the file is missing, damaged
+ * or was written by an incompatible build.
+ */
+bool snapshot_open(const char *path, struct snapshot *snap, bool verify);
+
+/*
+ * Pair stored for key (h is its snapshot_key_hash), or NULL
+ */
+const struct snapshot_pair *snapshot_find(const struct snapshot *snap,
+        const char *key, uint32_t h);
+
+void snapshot_close(struct snapshot *snap);
+
+#endif
@@ -0,0 +1,229 @@
+/**
+ * test_cache.c
+ *
+ * CS 470 Project 4
+ *
+ * Read-your-writes test for the read cache and hot-key replicas. Every
+ * process starts a get of each of its keys, overwrites the key while the
+ * get is in flight, then waits for the get; a dht_get afterwards must see
+ * the new value, not the one the late reply carried. Most keys are owned by
+ * other processes, so their values go through the cache. The next two cases
+ * get more keys than the cache holds while the first get is in flight, so a
+ * write (made here, or by process 1 and then invalidated here) has to be
+ * remembered past the eviction of its key.
+ *
+ * DHT options come from the environment (see dht.h); the cache holds 32
+ * values unless DHT_CACHE_SIZE says otherwise. With DHT_HOT_THRESHOLD set
+ * the cache is off by default, so gets reach the owners and hot keys are
+ * replicated instead; a last case then gets a few keys often enough that
+ * replicas must be received and answer gets. Exits with failure if any
+ * process saw an old value, or if no replica was received or used.
+ *
+ * Usage: test_cache [keys-per-process]
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dht.h"
+
+// Keys process 1 overwrites under process 0's gets
+#define SHARED_KEYS 8
+
+// Keys every process gets often enough to make them hot
+#define HOT_KEYS 8
+
+/*
+ * Overwrite a key while a get of it is in flight and many other gets evict
+ * it from the cache; returns the number of stale values seen
+ */
+static long evicted_write(int pid, int fill)
+{
+    char key[MAX_KEYLEN];
+    char other[MAX_KEYLEN];
+    snprintf(key, sizeof(key), "ev%d", pid);
+    dht_put(key, 1);
+    for (int i = 0; i < fill; i++) {
+        snprintf(other, sizeof(other), "ev%d-%d", pid, i);
+        dht_put(other, i);
+    }
+    dht_sync();
+
+    long errors = 0;
+    long value;
+    struct dht_request *req = dht_iget(key, &value);
+    dht_put(key, 2);
+    for (int i = 0; i < fill; i++) {
+        snprintf(other, sizeof(other), "ev%d-%d", pid, i);
+        if (dht_get(other) != i) {
+            errors++;
+        }
+    }
+    dht_wait(&req);
+    if (dht_get(key) != 2) {
+        errors++;
+    }
+    return errors;
+}
+
+/*
+ * Process 1 overwrites keys that process 0 is getting, and process 0 then
+ * evicts them before its gets complete; after a sync it must see the new
+ * values. Returns the number of stale values seen.
+ */
+static long shared_write(int pid, int fill)
+{
+    char key[SHARED_KEYS][MAX_KEYLEN];
+    long value[SHARED_KEYS];
+    struct dht_request *reqs[SHARED_KEYS];
+    for (int k = 0; k < SHARED_KEYS; k++) {
+        snprintf(key[k], MAX_KEYLEN, "xr%d", k);
+    }
+    if (pid == 0) {
+        for (int k = 0; k < SHARED_KEYS; k++) {
+            dht_put(key[k], 1);
+        }
+    }
+    dht_sync();
+
+    // updates bypass the cache, so they carry the handshake
+    long errors = 0;
+    if (pid == 0) {
+        for (int k = 0; k < SHARED_KEYS; k++) {
+            reqs[k] = dht_iget(key[k], &value[k]);
+        }
+        dht_add("xr-asked", 1);
+        while (dht_add("xr-written", 0) == 0) {
+        }
+        char other[MAX_KEYLEN];
+        for (int i = 0; i < fill; i++) {
+            snprintf(other, sizeof(other), "ev%d-%d", pid, i);
+            if (dht_get(other) != i) {
+                errors++;
+            }
+        }
+        dht_waitall(reqs, SHARED_KEYS);
+    } else if (pid == 1) {
+        while (dht_add("xr-asked", 0) == 0) {
+        }
+        for (int k = 0; k < SHARED_KEYS; k++) {
+            dht_put(key[k], 2);
+        }
+        dht_add("xr-written", 1);
+    }
+    dht_sync();
+
+    for (int k = 0; k < SHARED_KEYS; k++) {
+        if (dht_get(key[k]) != 2) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/*
+ * Get a few keys threshold times over from every process, then check that
+ * replicas were received and used somewhere; returns the number of stale
+ * values seen, plus one if replication did nothing
+ */
+static long hot_reads(int pid, int threshold)
+{
+    char key[MAX_KEYLEN];
+    if (pid == 0) {
+        for (int k = 0; k < HOT_KEYS; k++) {
+            snprintf(key, sizeof(key), "hot%d", k);
+            dht_put(key, k);
+        }
+    }
+    dht_sync();
+
+    long errors = 0;
+    for (int r = 0; r < 4 * threshold; r++) {
+        for (int k = 0; k < HOT_KEYS; k++) {
+            snprintf(key, sizeof(key), "hot%d", k);
+            if (dht_get(key) != k) {
+                errors++;
+            }
+        }
+    }
+    dht_sync();
+
+    struct replica_stats stats;
+    dht_replica_stats(&stats);
+    unsigned long mine[2] = { stats.received, stats.hits };
+    unsigned long total[2];
+    MPI_Allreduce(mine, total, 2, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (pid == 0) {
+        printf("test_cache: %lu replicas received, %lu gets answered by them\n",
+               total[0], total[1]);
+        if (total[0] == 0 || total[1] == 0) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int keys = argc > 1 ? atoi(argv[1]) : 256;
+
+    struct dht_options opts;
+    dht_default_options(&opts);
+    if (getenv("DHT_CACHE_SIZE") == NULL) {
+        opts.cache_size = opts.hot_threshold > 0 ? 0 : 32;
+    }
+    int pid = dht_init_opts(&opts);
+
+    long errors = 0;
+    char key[MAX_KEYLEN];
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < keys; i++) {
+            snprintf(key, sizeof(key), "rw%d-%d", pid, i);
+            long old = 2 * round + 1;
+            long value;
+
+            dht_put(key, old);
+            struct dht_request *req = dht_iget(key, &value);
+            dht_put(key, old + 1);
+            dht_wait(&req);
+            if (value != old && value != old + 1) {
+                errors++;
+            }
+            if (dht_get(key) != old + 1) {
+                errors++;
+            }
+        }
+
+        // the keys become cacheable again after a sync
+        dht_sync();
+        for (int i = 0; i < keys; i++) {
+            snprintf(key, sizeof(key), "rw%d-%d", pid, i);
+            if (dht_get(key) != 2 * round + 2) {
+                errors++;
+            }
+        }
+    }
+
+    // enough other gets to evict any key from the cache
+    int fill = 4 * (int)(opts.cache_size > 0 ? opts.cache_size : 32);
+    errors += evicted_write(pid, fill);
+    int nprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    if (nprocs > 1) {
+        errors += shared_write(pid, fill);
+        if (opts.hot_threshold > 0 && opts.cache_size == 0) {
+            errors += hot_reads(pid, opts.hot_threshold);
+        }
+    }
+
+    // every process has its replies before any leaves the DHT
+    dht_sync();
+    long total;
+    MPI_Allreduce(&errors, &total, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (pid == 0) {
+        printf("test_cache: %s (%ld stale values)\n", total == 0 ? "ok" : "FAILED", total);
+    }
+    dht_destroy(NULL);
+    return total == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
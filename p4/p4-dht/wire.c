@@ -0,0 +1,85 @@
+/**
+ * wire.c
+ *
+ * CS 470 Project 4
+ *
+ * Packing and unpacking of compact DHT wire records (see wire.h).
+ */
+
+#include "wire.h"
+
+size_t wire_key_length(const char *key)
+{
+    size_t keylen = 0;
+    if (key != NULL) {
+        while (keylen < MAX_KEYLEN-1 && key[keylen] != '\0') {
+            keylen++;
+        }
+    }
+    return keylen;
+}
+
+size_t wire_pack(char *buf, int op, const char *key, int flags, long value)
+{
+    size_t keylen = wire_key_length(key);
+
+    buf[0] = (char)op;
+    buf[1] = (char)flags;
+    buf[2] = (char)keylen;
+    if (keylen > 0) {
+        memcpy(buf + WIRE_HEADER_BYTES, key, keylen);
+    }
+    size_t used = WIRE_HEADER_BYTES + keylen;
+
+    if (flags & WIRE_HAS_VALUE) {
+        int64_t v = value;
+        memcpy(buf + used, &v, sizeof(v));
+        used += sizeof(v);
+    }
+    return used;
+}
+
+size_t wire_pack_expected(char *buf, int op, const char *key, long value, long expected)
+{
+    size_t used = wire_pack(buf, op, key, WIRE_HAS_VALUE | WIRE_HAS_EXPECTED, value);
+    int64_t e = expected;
+    memcpy(buf + used, &e, sizeof(e));
+    return used + sizeof(e);
+}
+
+size_t wire_unpack(const char *buf, size_t avail, struct wire_record *rec)
+{
+    if (avail < WIRE_HEADER_BYTES) {
+        return 0;
+    }
+    rec->op = (uint8_t)buf[0];
+    rec->flags = (uint8_t)buf[1];
+    rec->keylen = (uint8_t)buf[2];
+    if (rec->keylen >= MAX_KEYLEN) {
+        return 0;
+    }
+
+    size_t used = WIRE_HEADER_BYTES + rec->keylen;
+    size_t need = used + ((rec->flags & WIRE_HAS_VALUE) ? sizeof(int64_t) : 0)
+        + ((rec->flags & WIRE_HAS_EXPECTED) ? sizeof(int64_t) : 0);
+    if (avail < need) {
+        return 0;
+    }
+
+    memcpy(rec->key, buf + WIRE_HEADER_BYTES, rec->keylen);
+    rec->key[rec->keylen] = '\0';
+    rec->value = 0;
+    rec->expected = 0;
+    if (rec->flags & WIRE_HAS_VALUE) {
+        int64_t v;
+        memcpy(&v, buf + used, sizeof(v));
+        rec->value = (long)v;
+        used += sizeof(v);
+    }
+    if (rec->flags & WIRE_HAS_EXPECTED) {
+        int64_t e;
+        memcpy(&e, buf + used, sizeof(e));
+        rec->expected = (long)e;
+    }
+    return need;
+}
@@ -0,0 +1,82 @@
+/**
+ * wire.h
+ *
+ * CS 470 Project 4
+ *
+ * Compact wire format for DHT messages. A message is a sequence of packed
+ * records; each record is a three-byte header (op, flags, key length)
+ * followed by only the key bytes actually used (no terminator) and, if the
+ * WIRE_HAS_VALUE flag is set, an eight-byte value (and, with
+ * WIRE_HAS_EXPECTED, a second one for compare-and-swap). Messages that carry no
+ * key or value (confirmations, size requests, shutdown) are sent empty.
+ */
+
+#ifndef __WIRE_H
+#define __WIRE_H
+
+#include <stdint.h>
+
+#include "local.h"
+
+#define WIRE_HEADER_BYTES 3
+
+// Largest possible record: header, longest key, value, expected value
+#define WIRE_MAX_RECORD (WIRE_HEADER_BYTES + MAX_KEYLEN + 2 * sizeof(int64_t))
+
+// Largest message a server accepts; receives are pre-posted at this size, so
+// senders split longer batches
+#define WIRE_MAX_MESSAGE (64 * 1024)
+
+// Record operations
+#define WIRE_PUT 1
+#define WIRE_GET 2
+#define WIRE_REPLY_TAG 3    // value is the tag the reply must be sent with
+#define WIRE_INVALIDATE 4   // value is the version that replaced the cached one
+#define WIRE_ADD 5          // value is the amount to add
+#define WIRE_CAS 6          // value replaces expected
+#define WIRE_MAX 7          // value replaces anything smaller
+#define WIRE_REPLICA 8      // value of a hot key; expected is its version
+#define WIRE_SCAN_LO 9      // the key is a scan's lower bound (inclusive)
+#define WIRE_SCAN_HI 10     // the key is a scan's upper bound (exclusive)
+#define WIRE_SCAN_PREFIX 11 // the key is the prefix of every key scanned
+
+// Record flags
+#define WIRE_HAS_VALUE 0x01
+#define WIRE_WANT_VERSION 0x02  // get: reply with the value and its version
+#define WIRE_HAS_EXPECTED 0x04  // an expected value follows the value
+
+/*
+ * Unpacked record. The key is copied out and NUL-terminated.
+ */
+struct wire_record {
+    uint8_t op;
+    uint8_t flags;
+    uint8_t keylen;
+    char key[MAX_KEYLEN];
+    long value;
+    long expected;
+};
+
+/*
+ * Number of key bytes a record carries for key (at most MAX_KEYLEN-1)
+ */
+size_t wire_key_length(const char *key);
+
+/*
+ * Append a record to buf and return the number of bytes written (at most
+ * WIRE_MAX_RECORD). Keys are truncated to MAX_KEYLEN-1 characters.
+ */
+size_t wire_pack(char *buf, int op, const char *key, int flags, long value);
+
+/*
+ * Same as wire_pack, with an expected value as well (for WIRE_CAS)
+ */
+size_t wire_pack_expected(char *buf, int op, const char *key, long value, long expected);
+
+/*
+ * Decode the record at the start of buf (avail bytes long). Returns the
+ * number of bytes consumed, or zero if the record is truncated or invalid.
+ */
+size_t wire_unpack(const char *buf, size_t avail, struct wire_record *rec);
+
+#endif